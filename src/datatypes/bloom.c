@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bloom.h"
+
+static void probe_indexes(const Bloom *bloom, const char *key, size_t *indexes);
+
+//(The user has to free up memory.)
+Bloom *bloom_create(size_t count)
+{
+    Bloom *bloom = malloc(sizeof(Bloom));
+    if (bloom == NULL)
+    {
+        return NULL;
+    }
+
+    bloom->counters = calloc(count, sizeof(uint8_t));
+    if (bloom->counters == NULL)
+    {
+        free(bloom);
+        return NULL;
+    }
+    bloom->count = count;
+
+    return bloom;
+}
+
+//(FREEING UP MEMORY.)
+void bloom_destroy(Bloom *bloom)
+{
+    free(bloom->counters);
+    free(bloom);
+}
+
+size_t bloom_memory_usage(const Bloom *bloom)
+{
+    return sizeof(Bloom) + bloom->count * sizeof(uint8_t);
+}
+
+void bloom_add(Bloom *bloom, const char *key)
+{
+    size_t indexes[BLOOM_PROBES];
+    probe_indexes(bloom, key, indexes);
+    for (int i = 0; i < BLOOM_PROBES; i++)
+    {
+        if (bloom->counters[indexes[i]] < UINT8_MAX)
+        {
+            bloom->counters[indexes[i]]++;
+        }
+    }
+}
+
+void bloom_remove(Bloom *bloom, const char *key)
+{
+    size_t indexes[BLOOM_PROBES];
+    probe_indexes(bloom, key, indexes);
+    for (int i = 0; i < BLOOM_PROBES; i++)
+    {
+        //A full counter may stand for more keys than it can count
+        if (bloom->counters[indexes[i]] > 0 && bloom->counters[indexes[i]] < UINT8_MAX)
+        {
+            bloom->counters[indexes[i]]--;
+        }
+    }
+}
+
+bool bloom_may_contain(const Bloom *bloom, const char *key)
+{
+    size_t indexes[BLOOM_PROBES];
+    probe_indexes(bloom, key, indexes);
+    for (int i = 0; i < BLOOM_PROBES; i++)
+    {
+        if (bloom->counters[indexes[i]] == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void bloom_clear(Bloom *bloom)
+{
+    memset(bloom->counters, 0, bloom->count * sizeof(uint8_t));
+}
+
+/**
+ * @brief Computes the counters of a key.
+ *
+ * One FNV-1a hash of the key, split in two halves that are combined into
+ * BLOOM_PROBES indexes (double hashing).
+ * @param Bloom* Pointer to a filter.
+ * @param Char* The key.
+ * @param size_t* Filled with BLOOM_PROBES indexes.
+ * @return Void
+ */
+static void probe_indexes(const Bloom *bloom, const char *key, size_t *indexes)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; key[i] != '\0'; i++)
+    {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+
+    //An odd step visits different counters in a power of two
+    uint32_t first = (uint32_t)hash;
+    uint32_t step = (uint32_t)(hash >> 32) | 1;
+    for (int i = 0; i < BLOOM_PROBES; i++)
+    {
+        indexes[i] = (first + (size_t)i * step) & (bloom->count - 1);
+    }
+}
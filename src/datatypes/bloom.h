@@ -0,0 +1,100 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @defgroup bloom bloom.h
+ * @brief The header file for the functions used in the Bloom filter.
+ * A counting Bloom filter over string keys. A key that was added is always
+ * reported as maybe present, a key that was not is reported as absent
+ * unless all of its counters were raised by other keys. Every counter is a
+ * byte, so keys can be removed again. A counter that reaches its largest
+ * value stays there, which only costs false positives.
+ *
+ * @{
+ */
+
+#define BLOOM_PROBES 4
+
+/**
+ * @brief The structure for a "bloom" filter.
+ *
+ * "count" is the number of counters, a power of two. Each key raises the
+ * counters at BLOOM_PROBES indexes derived from its hash.
+ */
+typedef struct bloom
+{
+    uint8_t *counters;
+    size_t count;
+} Bloom;
+
+/**
+ * @brief Creates an empty filter.
+ *
+ * <b>OBS</b>: The user has to free up memory with "bloom_destroy".
+ * @param size_t The number of counters, a power of two.
+ * @return *Bloom A pointer to the filter, NULL if out of memory.
+ */
+Bloom *bloom_create(size_t count);
+
+/**
+ * @brief Deallocate the filter.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ * @param Bloom* Pointer to a filter.
+ * @return Void
+ */
+void bloom_destroy(Bloom *bloom);
+
+/**
+ * @brief Returns the number of bytes held by the filter.
+ *
+ * @param Bloom* Pointer to a filter.
+ * @return size_t Bytes used by the filter.
+ */
+size_t bloom_memory_usage(const Bloom *bloom);
+
+/**
+ * @brief Adds a key.
+ *
+ * @param Bloom* Pointer to a filter.
+ * @param Char* The key.
+ * @return Void
+ */
+void bloom_add(Bloom *bloom, const char *key);
+
+/**
+ * @brief Removes a key that was added before.
+ *
+ * Removing a key that was never added can make the filter forget others.
+ * @param Bloom* Pointer to a filter.
+ * @param Char* The key.
+ * @return Void
+ */
+void bloom_remove(Bloom *bloom, const char *key);
+
+/**
+ * @brief Checks if a key may have been added.
+ *
+ * @param Bloom* Pointer to a filter.
+ * @param Char* The key.
+ * @return Bool False if the key was certainly not added.
+ */
+bool bloom_may_contain(const Bloom *bloom, const char *key);
+
+/**
+ * @brief Removes all keys.
+ *
+ * @param Bloom* Pointer to a filter.
+ * @return Void
+ */
+void bloom_clear(Bloom *bloom);
+
+/**
+ * @}
+ */
+
+#endif /* BLOOM_H */
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include "bloom.h"
+
+#define COUNTERS 8192
+#define KEYS 1000
+
+static void make_key(char *key, int i)
+{
+    snprintf(key, 16, "%012d", i * 7919);
+}
+
+// Verify that every added key is found.
+static bool verify_added(Bloom *bloom)
+{
+    char key[16];
+    bool correct = true;
+
+    for (int i = 0; i < KEYS; i++)
+    {
+        make_key(key, i);
+        bloom_add(bloom, key);
+    }
+    for (int i = 0; i < KEYS; i++)
+    {
+        make_key(key, i);
+        if (!bloom_may_contain(bloom, key))
+        {
+            correct = false;
+        }
+    }
+
+    return correct;
+}
+
+// Verify that most keys that were never added are reported absent.
+static bool verify_absent(Bloom *bloom)
+{
+    char key[16];
+    int positives = 0;
+
+    for (int i = KEYS; i < 11 * KEYS; i++)
+    {
+        make_key(key, i);
+        if (bloom_may_contain(bloom, key))
+        {
+            positives++;
+        }
+    }
+
+    //Eight counters per key and four probes give about 2.4%
+    return positives < KEYS / 2;
+}
+
+// Remove half of the keys and verify the other half is still found.
+static bool verify_removed(Bloom *bloom)
+{
+    char key[16];
+    bool correct = true;
+    int positives = 0;
+
+    for (int i = 0; i < KEYS; i += 2)
+    {
+        make_key(key, i);
+        bloom_remove(bloom, key);
+    }
+    for (int i = 0; i < KEYS; i++)
+    {
+        make_key(key, i);
+        bool found = bloom_may_contain(bloom, key);
+        if (i % 2 == 1 && !found)
+        {
+            correct = false;
+        }
+        if (i % 2 == 0 && found)
+        {
+            positives++;
+        }
+    }
+
+    return correct && positives < KEYS / 20;
+}
+
+// Verify that a full counter is never lowered again.
+static bool verify_saturated(void)
+{
+    Bloom *bloom = bloom_create(1);
+    bool correct = true;
+
+    for (int i = 0; i < 300; i++)
+    {
+        bloom_add(bloom, "key");
+    }
+    for (int i = 0; i < 299; i++)
+    {
+        bloom_remove(bloom, "key");
+    }
+    if (!bloom_may_contain(bloom, "key"))
+    {
+        correct = false;
+    }
+
+    bloom_clear(bloom);
+    correct = correct && !bloom_may_contain(bloom, "key");
+    bloom_destroy(bloom);
+    return correct;
+}
+
+// Test program.
+int main(void)
+{
+    Bloom *bloom = bloom_create(COUNTERS);
+
+    bool added_ok = verify_added(bloom);
+    printf("Test added keys are found ... %s\n", added_ok ? "PASS" : "FAIL");
+
+    bool absent_ok = verify_absent(bloom);
+    printf("Test keys not added are absent ... %s\n", absent_ok ? "PASS" : "FAIL");
+
+    bool removed_ok = verify_removed(bloom);
+    printf("Test removing keys ... %s\n", removed_ok ? "PASS" : "FAIL");
+
+    bool saturated_ok = verify_saturated();
+    printf("Test saturated counters ... %s\n", saturated_ok ? "PASS" : "FAIL");
+
+    bloom_destroy(bloom);
+    return 0;
+}
@@ -1,3 +1,9 @@
+#ifndef HASH_H
+#define HASH_H
+
 #include <inttypes.h>
 #define hash_t uint8_t
+#define HASH_BUCKETS 256
 hash_t hash_ssn(char* ssn);
+
+#endif
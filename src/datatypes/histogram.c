@@ -0,0 +1,102 @@
+#include <string.h>
+#include "histogram.h"
+
+static int bucket_of(uint64_t value);
+static uint64_t bucket_high(int bucket);
+
+void histogram_init(Histogram *histogram)
+{
+    memset(histogram, 0, sizeof(Histogram));
+}
+
+void histogram_record(Histogram *histogram, uint64_t value)
+{
+    histogram->buckets[bucket_of(value)]++;
+    if (histogram->count == 0 || value < histogram->min)
+    {
+        histogram->min = value;
+    }
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+    histogram->count++;
+}
+
+uint64_t histogram_count(const Histogram *histogram)
+{
+    return histogram->count;
+}
+
+uint64_t histogram_min(const Histogram *histogram)
+{
+    return histogram->min;
+}
+
+uint64_t histogram_max(const Histogram *histogram)
+{
+    return histogram->max;
+}
+
+uint64_t histogram_percentile(const Histogram *histogram, double percentile)
+{
+    if (histogram->count == 0)
+    {
+        return 0;
+    }
+
+    //The rank of the value, counted from 1
+    uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->count + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank)
+        {
+            uint64_t high = bucket_high(bucket);
+            return high < histogram->max ? high : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+static int bucket_of(uint64_t value)
+{
+    if (value < 2 * HISTOGRAM_SUBS)
+    {
+        return value;
+    }
+
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent >= HISTOGRAM_MAX_BITS)
+    {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+
+    int shift = exponent - HISTOGRAM_SUB_BITS;
+    return shift * HISTOGRAM_SUBS + HISTOGRAM_SUBS + ((value >> shift) & (HISTOGRAM_SUBS - 1));
+}
+
+// The largest value counted in the bucket
+static uint64_t bucket_high(int bucket)
+{
+    if (bucket == HISTOGRAM_BUCKETS - 1)
+    {
+        return UINT64_MAX;
+    }
+    if (bucket < 2 * HISTOGRAM_SUBS)
+    {
+        return bucket;
+    }
+
+    int shift = (bucket - HISTOGRAM_SUBS) / HISTOGRAM_SUBS;
+    uint64_t sub = (bucket - HISTOGRAM_SUBS) % HISTOGRAM_SUBS;
+    uint64_t low = (HISTOGRAM_SUBS + sub) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
@@ -0,0 +1,91 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 3 // 2^3 buckets per power of two, at most 12.5% too high
+#define HISTOGRAM_SUBS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 40 // Larger values are counted in the last bucket
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUBS)
+
+/**
+ * @defgroup histogram histogram.h
+ * @brief The header file for the functions used in the histogram.
+ * The histogram counts values in buckets whose width grows with the value,
+ * like an HDR histogram. Values below 2 * HISTOGRAM_SUBS have a bucket
+ * each, every following power of two is split into HISTOGRAM_SUBS buckets.
+ * Recording a value is a few instructions and the memory used is fixed, so
+ * the histogram can be kept on a hot path.
+ *
+ * @{
+ */
+
+/**
+ * @brief The structure for a "histogram".
+ */
+typedef struct histogram
+{
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+/**
+ * @brief Empties a histogram.
+ *
+ * @param Histogram* Pointer to a histogram.
+ * @return Void
+ */
+void histogram_init(Histogram *histogram);
+
+/**
+ * @brief Counts a value.
+ *
+ * @param Histogram* Pointer to a histogram.
+ * @param uint64_t The value.
+ * @return Void
+ */
+void histogram_record(Histogram *histogram, uint64_t value);
+
+/**
+ * @brief Returns the number of values counted.
+ *
+ * @param Histogram* Pointer to a histogram.
+ * @return uint64_t Number of values.
+ */
+uint64_t histogram_count(const Histogram *histogram);
+
+/**
+ * @brief Returns the smallest value counted.
+ *
+ * @param Histogram* Pointer to a histogram.
+ * @return uint64_t The smallest value, 0 if the histogram is empty.
+ */
+uint64_t histogram_min(const Histogram *histogram);
+
+/**
+ * @brief Returns the largest value counted.
+ *
+ * @param Histogram* Pointer to a histogram.
+ * @return uint64_t The largest value, 0 if the histogram is empty.
+ */
+uint64_t histogram_max(const Histogram *histogram);
+
+/**
+ * @brief Returns the value at a percentile.
+ *
+ * The value is the upper bound of its bucket, but never above the largest
+ * value counted.
+ *
+ * @param Histogram* Pointer to a histogram.
+ * @param double The percentile, 0 to 100.
+ * @return uint64_t The value, 0 if the histogram is empty.
+ */
+uint64_t histogram_percentile(const Histogram *histogram, double percentile);
+
+/**
+ * @}
+ */
+
+#endif /* HISTOGRAM_H */
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include "histogram.h"
+
+#define VALUES 100000
+
+// Count 1 to VALUES and verify that every percentile is at most one
+// bucket width (12.5%) above the exact value.
+static bool verify_percentiles(Histogram *histogram)
+{
+    bool correct = true;
+
+    for (uint64_t value = 1; value <= VALUES; value++)
+    {
+        histogram_record(histogram, value);
+    }
+
+    double percentiles[] = {1, 50, 90, 99, 99.9};
+    for (int i = 0; i < 5; i++)
+    {
+        uint64_t exact = (uint64_t)(percentiles[i] / 100.0 * VALUES);
+        uint64_t value = histogram_percentile(histogram, percentiles[i]);
+        if (value < exact || value > exact + exact / HISTOGRAM_SUBS)
+        {
+            correct = false;
+        }
+    }
+
+    if (histogram_count(histogram) != VALUES || histogram_min(histogram) != 1 ||
+        histogram_max(histogram) != VALUES || histogram_percentile(histogram, 100) != VALUES)
+    {
+        correct = false;
+    }
+
+    return correct;
+}
+
+// Verify small values are exact and huge values land in the last bucket.
+static bool verify_edges(Histogram *histogram)
+{
+    bool correct = true;
+
+    histogram_init(histogram);
+    if (histogram_percentile(histogram, 50) != 0)
+    {
+        correct = false;
+    }
+
+    for (uint64_t value = 0; value < 2 * HISTOGRAM_SUBS; value++)
+    {
+        histogram_record(histogram, value);
+    }
+    if (histogram_percentile(histogram, 50) != HISTOGRAM_SUBS - 1)
+    {
+        correct = false;
+    }
+
+    histogram_record(histogram, UINT64_MAX);
+    if (histogram->buckets[HISTOGRAM_BUCKETS - 1] != 1 || histogram_percentile(histogram, 100) != UINT64_MAX)
+    {
+        correct = false;
+    }
+
+    return correct;
+}
+
+// Test program.
+int main(void)
+{
+    static Histogram histogram;
+    histogram_init(&histogram);
+
+    bool percentiles_ok = verify_percentiles(&histogram);
+    printf("Test percentiles within a bucket ... %s\n", percentiles_ok ? "PASS" : "FAIL");
+
+    bool edges_ok = verify_edges(&histogram);
+    printf("Test small and huge values ... %s\n", edges_ok ? "PASS" : "FAIL");
+
+    return 0;
+}
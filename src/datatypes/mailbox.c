@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+#include "mailbox.h"
+
+static unsigned char *slot_at(Mailbox *mailbox, size_t index);
+
+//(The user has to free up memory.)
+Mailbox *mailbox_create(size_t count, size_t slotSize)
+{
+    Mailbox *mailbox = malloc(sizeof(Mailbox));
+    if (mailbox == NULL)
+    {
+        return NULL;
+    }
+
+    //Keep every slot aligned for its size_t
+    mailbox->slotSize = (slotSize + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t);
+    mailbox->slots = malloc(count * (sizeof(size_t) + mailbox->slotSize));
+    if (mailbox->slots == NULL)
+    {
+        free(mailbox);
+        return NULL;
+    }
+    mailbox->count = count;
+    atomic_init(&mailbox->head, 0);
+    atomic_init(&mailbox->tail, 0);
+
+    return mailbox;
+}
+
+//(FREEING UP MEMORY.)
+void mailbox_destroy(Mailbox *mailbox)
+{
+    free(mailbox->slots);
+    free(mailbox);
+}
+
+bool mailbox_push(Mailbox *mailbox, const void *message, size_t size)
+{
+    size_t tail = atomic_load_explicit(&mailbox->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&mailbox->head, memory_order_acquire);
+    if (tail - head == mailbox->count || size > mailbox->slotSize)
+    {
+        return false;
+    }
+
+    unsigned char *slot = slot_at(mailbox, tail);
+    memcpy(slot, &size, sizeof(size_t));
+    memcpy(slot + sizeof(size_t), message, size);
+
+    //The consumer sees the slot filled once it sees the new tail
+    atomic_store_explicit(&mailbox->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+void *mailbox_front(Mailbox *mailbox, size_t *size)
+{
+    size_t head = atomic_load_explicit(&mailbox->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&mailbox->tail, memory_order_acquire);
+    if (head == tail)
+    {
+        return NULL;
+    }
+
+    unsigned char *slot = slot_at(mailbox, head);
+    memcpy(size, slot, sizeof(size_t));
+    return slot + sizeof(size_t);
+}
+
+void mailbox_pop(Mailbox *mailbox)
+{
+    size_t head = atomic_load_explicit(&mailbox->head, memory_order_relaxed);
+
+    //The producer may reuse the slot once it sees the new head
+    atomic_store_explicit(&mailbox->head, head + 1, memory_order_release);
+}
+
+bool mailbox_empty(Mailbox *mailbox)
+{
+    return atomic_load_explicit(&mailbox->head, memory_order_acquire) ==
+           atomic_load_explicit(&mailbox->tail, memory_order_acquire);
+}
+
+static unsigned char *slot_at(Mailbox *mailbox, size_t index)
+{
+    return mailbox->slots + (index & (mailbox->count - 1)) * (sizeof(size_t) + mailbox->slotSize);
+}
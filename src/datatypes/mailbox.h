@@ -0,0 +1,97 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/**
+ * @defgroup mailbox mailbox.h
+ * @brief The header file for the functions used in the mailbox.
+ * The mailbox passes messages from one producer thread to one consumer
+ * thread without locks. Every message is copied into a slot of fixed size,
+ * so a message is read in place and released with "mailbox_pop" once the
+ * consumer is done with it. Neither side ever waits, a full mailbox
+ * refuses the message and an empty one returns no message.
+ *
+ * @{
+ */
+
+/**
+ * @brief The structure for a "mailbox".
+ *
+ * "count" is a power of two. "head" and "tail" only grow, the message at
+ * "head" is in slot head & (count - 1) and "tail - head" slots are used.
+ * A slot is a size_t holding the size of the message, followed by
+ * "slotSize" bytes for the message.
+ */
+typedef struct mailbox
+{
+    unsigned char *slots;
+    size_t count;
+    size_t slotSize;
+    _Alignas(64) atomic_size_t head; // Written by the consumer only
+    _Alignas(64) atomic_size_t tail; // Written by the producer only
+} Mailbox;
+
+/**
+ * @brief Creates an empty mailbox.
+ *
+ * <b>OBS</b>: The user has to free up memory with "mailbox_destroy".
+ * @param size_t The number of slots, a power of two.
+ * @param size_t The largest message in bytes.
+ * @return *Mailbox A pointer to the mailbox, NULL if out of memory.
+ */
+Mailbox *mailbox_create(size_t count, size_t slotSize);
+
+/**
+ * @brief Deallocate the mailbox.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ * @param Mailbox* Pointer to a mailbox.
+ * @return Void
+ */
+void mailbox_destroy(Mailbox *mailbox);
+
+/**
+ * @brief Copies a message into the mailbox, called by the producer.
+ *
+ * @param Mailbox* Pointer to a mailbox.
+ * @param Void* The message.
+ * @param size_t The size of the message, at most the slot size.
+ * @return Bool False if the mailbox is full or the message too large.
+ */
+bool mailbox_push(Mailbox *mailbox, const void *message, size_t size);
+
+/**
+ * @brief Returns the oldest message, called by the consumer.
+ *
+ * The message stays valid until "mailbox_pop".
+ *
+ * @param Mailbox* Pointer to a mailbox.
+ * @param size_t* Set to the size of the message.
+ * @return Void* The message, NULL if the mailbox is empty.
+ */
+void *mailbox_front(Mailbox *mailbox, size_t *size);
+
+/**
+ * @brief Releases the oldest message, called by the consumer.
+ *
+ * @param Mailbox* Pointer to a non-empty mailbox.
+ * @return Void
+ */
+void mailbox_pop(Mailbox *mailbox);
+
+/**
+ * @brief Checks if the mailbox is empty, from either side.
+ *
+ * @param Mailbox* Pointer to a mailbox.
+ * @return Bool True if there is no message.
+ */
+bool mailbox_empty(Mailbox *mailbox);
+
+/**
+ * @}
+ */
+
+#endif /* MAILBOX_H */
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "mailbox.h"
+
+#define SLOTS 8
+#define SLOT_SIZE 32
+#define MESSAGES 200000
+
+// Fill the mailbox, verify it refuses more, and read the messages back.
+static bool verify_full(Mailbox *mailbox)
+{
+    char message[SLOT_SIZE + 1];
+    bool correct = true;
+
+    for (int i = 0; i < SLOTS; i++)
+    {
+        int size = snprintf(message, sizeof(message), "message %d", i);
+        if (!mailbox_push(mailbox, message, size))
+        {
+            correct = false;
+        }
+    }
+    if (mailbox_push(mailbox, "one too many", 12) || mailbox_empty(mailbox))
+    {
+        correct = false;
+    }
+
+    for (int i = 0; i < SLOTS; i++)
+    {
+        size_t size;
+        char *front = mailbox_front(mailbox, &size);
+        int expected = snprintf(message, sizeof(message), "message %d", i);
+        if (front == NULL || size != (size_t)expected || memcmp(front, message, size) != 0)
+        {
+            correct = false;
+        }
+        mailbox_pop(mailbox);
+    }
+
+    return correct && mailbox_empty(mailbox) && mailbox_front(mailbox, &(size_t){0}) == NULL;
+}
+
+// Verify that a message larger than a slot is refused.
+static bool verify_too_large(Mailbox *mailbox)
+{
+    char message[SLOT_SIZE + 1] = {0};
+    return mailbox_push(mailbox, message, SLOT_SIZE) && !mailbox_push(mailbox, message, SLOT_SIZE + 1);
+}
+
+static void *produce(void *arg)
+{
+    Mailbox *mailbox = arg;
+    for (unsigned i = 0; i < MESSAGES; i++)
+    {
+        while (!mailbox_push(mailbox, &i, sizeof(i)))
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// Pass messages from another thread and verify none is lost or reordered.
+static bool verify_threads(Mailbox *mailbox)
+{
+    pthread_t producer;
+    bool correct = true;
+
+    pthread_create(&producer, NULL, produce, mailbox);
+    for (unsigned i = 0; i < MESSAGES; i++)
+    {
+        size_t size;
+        unsigned *front;
+        while ((front = mailbox_front(mailbox, &size)) == NULL)
+        {
+            sched_yield();
+        }
+        if (size != sizeof(unsigned) || *front != i)
+        {
+            correct = false;
+        }
+        mailbox_pop(mailbox);
+    }
+    pthread_join(producer, NULL);
+
+    return correct && mailbox_empty(mailbox);
+}
+
+// Test program.
+int main(void)
+{
+    Mailbox *mailbox = mailbox_create(SLOTS, SLOT_SIZE);
+
+    bool full_ok = verify_full(mailbox);
+    printf("Test full and empty mailbox ... %s\n", full_ok ? "PASS" : "FAIL");
+
+    bool large_ok = verify_too_large(mailbox);
+    printf("Test message larger than a slot ... %s\n", large_ok ? "PASS" : "FAIL");
+    mailbox_pop(mailbox);
+
+    bool threads_ok = verify_threads(mailbox);
+    printf("Test messages between threads ... %s\n", threads_ok ? "PASS" : "FAIL");
+
+    mailbox_destroy(mailbox);
+    return 0;
+}
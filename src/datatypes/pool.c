@@ -0,0 +1,148 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "pool.h"
+
+#define POOL_ALIGN 16
+#define POOL_FIRST_SLAB 2048
+#define POOL_MAX_SLAB 65536
+#define SLAB_HEADER ((sizeof(struct pool_slab) + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1))
+
+/**
+ * @defgroup pool_static Static_Pool
+ *
+ * @brief "pool.c" contains the functions used to make a slab pool.
+ *
+ * @{
+ */
+
+/**
+ * @brief Gets the size class of a block size.
+ *
+ * @param size_t The wanted size.
+ * @return int The size class, 0 for 16 bytes up to 4 for 256 bytes.
+ */
+static int size_class(size_t size)
+{
+    int class = 0;
+    size_t blockSize = POOL_MIN_BLOCK;
+
+    while (blockSize < size)
+    {
+        blockSize <<= 1;
+        class++;
+    }
+    return class;
+}
+
+/**
+ * @brief Adds a new slab that is big enough for a block.
+ *
+ * What was left of the previous slab is kept on the free lists.
+ *
+ * @param Pool* The pool.
+ * @param size_t The block size that did not fit.
+ * @return Bool False if memory could not be allocated.
+ */
+static bool add_slab(Pool *pool, size_t blockSize)
+{
+    // Hand the tail of the old slab to the free lists, largest blocks first.
+    for (int class = POOL_CLASSES - 1; class >= 0; class--)
+    {
+        size_t size = (size_t)POOL_MIN_BLOCK << class;
+        while (pool->remaining >= size)
+        {
+            struct pool_block *block = (struct pool_block *)pool->cursor;
+            block->next = pool->free[class];
+            pool->free[class] = block;
+            pool->cursor += size;
+            pool->remaining -= size;
+        }
+    }
+
+    size_t size = pool->nextSlabSize;
+    struct pool_slab *slab = malloc(SLAB_HEADER + size);
+    if (slab == NULL)
+    {
+        return false;
+    }
+
+    slab->next = pool->slabs;
+    slab->size = size;
+    pool->slabs = slab;
+    pool->cursor = (unsigned char *)slab + SLAB_HEADER;
+    pool->remaining = size;
+    pool->reserved += SLAB_HEADER + size;
+
+    if (pool->nextSlabSize < POOL_MAX_SLAB)
+    {
+        pool->nextSlabSize <<= 1;
+    }
+    return pool->remaining >= blockSize;
+}
+
+/**
+ * @}
+ */
+
+//(The user has to free up memory.)
+Pool *pool_create(void)
+{
+    Pool *pool = calloc(1, sizeof(Pool));
+    pool->nextSlabSize = POOL_FIRST_SLAB;
+    return pool;
+}
+
+//(FREEING UP MEMORY.)
+void pool_destroy(Pool *pool)
+{
+    struct pool_slab *slab = pool->slabs;
+    while (slab != NULL)
+    {
+        struct pool_slab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+
+    free(pool);
+}
+
+void *pool_alloc(Pool *pool, size_t size)
+{
+    int class = size_class(size);
+    size_t blockSize = (size_t)POOL_MIN_BLOCK << class;
+
+    struct pool_block *block = pool->free[class];
+    if (block != NULL)
+    {
+        pool->free[class] = block->next;
+        return block;
+    }
+
+    if (pool->remaining < blockSize && !add_slab(pool, blockSize))
+    {
+        return NULL;
+    }
+
+    void *out = pool->cursor;
+    pool->cursor += blockSize;
+    pool->remaining -= blockSize;
+    return out;
+}
+
+void pool_free(Pool *pool, void *block, size_t size)
+{
+    if (block == NULL)
+    {
+        return;
+    }
+
+    int class = size_class(size);
+    struct pool_block *freed = block;
+    freed->next = pool->free[class];
+    pool->free[class] = freed;
+}
+
+size_t pool_reserved(const Pool *pool)
+{
+    return pool->reserved;
+}
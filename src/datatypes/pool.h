@@ -0,0 +1,106 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+#define POOL_CLASSES 5
+#define POOL_MIN_BLOCK 16
+#define POOL_MAX_BLOCK 256
+
+/**
+ * @defgroup pool pool.h
+ * @brief The header file for the functions used in the slab pool.
+ * The pool hands out blocks of 16, 32, 64, 128 or 256 bytes carved from
+ * large slabs. Freed blocks are kept on a free list per size class and
+ * reused, and all slabs are released together when the pool is destroyed,
+ * so the user never has to free the blocks one by one.
+ *
+ * @{
+ */
+
+/**
+ * @brief A free block, linked into the free list of its size class.
+ */
+struct pool_block
+{
+    struct pool_block *next;
+};
+
+/**
+ * @brief A slab of memory that blocks are carved from.
+ */
+struct pool_slab
+{
+    struct pool_slab *next;
+    size_t size;
+};
+
+/**
+ * @brief The structure for a "pool".
+ *
+ * New blocks are bumped from "cursor" in the newest slab. Slabs double in
+ * size up to a limit, so small pools stay small. "reserved" is the number
+ * of bytes held in slabs.
+ */
+typedef struct pool
+{
+    struct pool_slab *slabs;
+    unsigned char *cursor;
+    size_t remaining;
+    size_t nextSlabSize;
+    size_t reserved;
+    struct pool_block *free[POOL_CLASSES];
+} Pool;
+
+/**
+ * @brief Creates an empty pool.
+ *
+ * <b>OBS</b>: The user has to free up memory with "pool_destroy".
+ * @param Void
+ * @return *Pool A pointer to the pool.
+ */
+Pool *pool_create(void);
+
+/**
+ * @brief Releases all slabs of the pool at once.
+ *
+ * Every block handed out by the pool is invalid afterwards.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ * @param Pool* Pointer to a pool.
+ * @return Void
+ */
+void pool_destroy(Pool *pool);
+
+/**
+ * @brief Allocates a block of at least "size" bytes.
+ *
+ * @param Pool* Pointer to a pool.
+ * @param size_t The wanted size, at most POOL_MAX_BLOCK.
+ * @return Void* A block aligned to 16 bytes.
+ */
+void *pool_alloc(Pool *pool, size_t size);
+
+/**
+ * @brief Returns a block to the pool.
+ *
+ * @param Pool* Pointer to a pool.
+ * @param Void* The block, or NULL.
+ * @param size_t The size that was given to "pool_alloc".
+ * @return Void
+ */
+void pool_free(Pool *pool, void *block, size_t size);
+
+/**
+ * @brief Returns the number of bytes the pool holds in slabs.
+ *
+ * @param Pool* Pointer to a pool.
+ * @return size_t Bytes reserved, including free blocks.
+ */
+size_t pool_reserved(const Pool *pool);
+
+/**
+ * @}
+ */
+
+#endif /* POOL_H */
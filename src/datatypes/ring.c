@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+
+//(The user has to free up memory.)
+Ring *ring_create(size_t capacity)
+{
+    Ring *ring = malloc(sizeof(Ring));
+    ring->data = malloc(capacity);
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->tail = 0;
+
+    return ring;
+}
+
+//(FREEING UP MEMORY.)
+void ring_destroy(Ring *ring)
+{
+    free(ring->data);
+    free(ring);
+}
+
+void ring_clear(Ring *ring)
+{
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+size_t ring_length(const Ring *ring)
+{
+    return ring->tail - ring->head;
+}
+
+size_t ring_space(const Ring *ring)
+{
+    return ring->capacity - (ring->tail - ring->head);
+}
+
+unsigned char ring_at(const Ring *ring, size_t offset)
+{
+    return ring->data[(ring->head + offset) & (ring->capacity - 1)];
+}
+
+int ring_free_iov(Ring *ring, struct iovec iov[2])
+{
+    size_t space = ring_space(ring);
+    size_t start = ring->tail & (ring->capacity - 1);
+    size_t first = ring->capacity - start;
+
+    if (space == 0)
+    {
+        return 0;
+    }
+    if (first >= space)
+    {
+        iov[0] = (struct iovec){.iov_base = &ring->data[start], .iov_len = space};
+        return 1;
+    }
+
+    iov[0] = (struct iovec){.iov_base = &ring->data[start], .iov_len = first};
+    iov[1] = (struct iovec){.iov_base = ring->data, .iov_len = space - first};
+    return 2;
+}
+
+int ring_data_iov(const Ring *ring, struct iovec iov[2])
+{
+    size_t length = ring_length(ring);
+    size_t start = ring->head & (ring->capacity - 1);
+    size_t first = ring->capacity - start;
+
+    if (length == 0)
+    {
+        return 0;
+    }
+    if (first >= length)
+    {
+        iov[0] = (struct iovec){.iov_base = &ring->data[start], .iov_len = length};
+        return 1;
+    }
+
+    iov[0] = (struct iovec){.iov_base = &ring->data[start], .iov_len = first};
+    iov[1] = (struct iovec){.iov_base = ring->data, .iov_len = length - first};
+    return 2;
+}
+
+void ring_produce(Ring *ring, size_t n)
+{
+    ring->tail += n;
+}
+
+bool ring_write(Ring *ring, const void *data, size_t n)
+{
+    struct iovec iov[2];
+
+    if (n > ring_space(ring))
+    {
+        return false;
+    }
+
+    int count = ring_free_iov(ring, iov);
+    size_t first = n < iov[0].iov_len ? n : iov[0].iov_len;
+    memcpy(iov[0].iov_base, data, first);
+    if (count == 2 && n > first)
+    {
+        memcpy(iov[1].iov_base, (const unsigned char *)data + first, n - first);
+    }
+
+    ring->tail += n;
+    return true;
+}
+
+bool ring_resize(Ring *ring, size_t capacity)
+{
+    struct iovec iov[2];
+    size_t length = 0;
+    unsigned char *data = malloc(capacity);
+
+    if (data == NULL)
+    {
+        return false;
+    }
+
+    int count = ring_data_iov(ring, iov);
+    for (int i = 0; i < count; i++)
+    {
+        memcpy(&data[length], iov[i].iov_base, iov[i].iov_len);
+        length += iov[i].iov_len;
+    }
+    free(ring->data);
+    ring->data = data;
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->tail = length;
+    return true;
+}
+
+void ring_truncate(Ring *ring, size_t length)
+{
+    ring->tail = ring->head + length;
+}
+
+unsigned char *ring_peek(Ring *ring, size_t n, unsigned char *scratch)
+{
+    size_t start = ring->head & (ring->capacity - 1);
+    size_t first = ring->capacity - start;
+
+    if (first >= n)
+    {
+        return &ring->data[start];
+    }
+
+    memcpy(scratch, &ring->data[start], first);
+    memcpy(&scratch[first], ring->data, n - first);
+    return scratch;
+}
+
+void ring_consume(Ring *ring, size_t n)
+{
+    ring->head += n;
+    if (ring->head == ring->tail)
+    {
+        // Start over at the beginning so messages rarely wrap.
+        ring->head = 0;
+        ring->tail = 0;
+    }
+}
@@ -0,0 +1,170 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+/**
+ * @defgroup ring ring.h
+ * @brief The header file for the functions used in the byte ring buffer.
+ * The ring keeps a stream of bytes between a producer (socket reads) and a
+ * consumer (the state machine). Consuming bytes only moves an index, and
+ * the free and used parts of the ring are handed out as at most two
+ * iovecs so reads and writes can go straight to and from the ring.
+ *
+ * @{
+ */
+
+/**
+ * @brief The structure for a "ring".
+ *
+ * "capacity" is a power of two. "head" and "tail" only grow, the byte at
+ * "head" is data[head & (capacity - 1)] and "tail - head" bytes are used.
+ */
+typedef struct ring
+{
+    unsigned char *data;
+    size_t capacity;
+    size_t head;
+    size_t tail;
+} Ring;
+
+/**
+ * @brief Creates an empty ring.
+ *
+ * <b>OBS</b>: The user has to free up memory with "ring_destroy".
+ * @param size_t The capacity in bytes, a power of two.
+ * @return *Ring A pointer to the ring.
+ */
+Ring *ring_create(size_t capacity);
+
+/**
+ * @brief Deallocate the ring.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ * @param Ring* Pointer to a ring.
+ * @return Void
+ */
+void ring_destroy(Ring *ring);
+
+/**
+ * @brief Drops all bytes in the ring.
+ *
+ * @param Ring* Pointer to a ring.
+ * @return Void
+ */
+void ring_clear(Ring *ring);
+
+/**
+ * @brief Returns the number of bytes in the ring.
+ *
+ * @param Ring* Pointer to a ring.
+ * @return size_t Bytes that can be consumed.
+ */
+size_t ring_length(const Ring *ring);
+
+/**
+ * @brief Returns the number of free bytes in the ring.
+ *
+ * @param Ring* Pointer to a ring.
+ * @return size_t Bytes that can be produced.
+ */
+size_t ring_space(const Ring *ring);
+
+/**
+ * @brief Gets a byte relative to the head of the ring.
+ *
+ * @param Ring* Pointer to a ring.
+ * @param size_t Offset from the head, less than "ring_length".
+ * @return unsigned char The byte.
+ */
+unsigned char ring_at(const Ring *ring, size_t offset);
+
+/**
+ * @brief Describes the free part of the ring.
+ *
+ * Fill the iovecs (for example with readv) and then call "ring_produce".
+ *
+ * @param Ring* Pointer to a ring.
+ * @param iovec[2] Set to the free regions.
+ * @return int Number of iovecs used, 0 if the ring is full.
+ */
+int ring_free_iov(Ring *ring, struct iovec iov[2]);
+
+/**
+ * @brief Describes the used part of the ring.
+ *
+ * Send the iovecs (for example with writev) and then call "ring_consume".
+ *
+ * @param Ring* Pointer to a ring.
+ * @param iovec[2] Set to the used regions.
+ * @return int Number of iovecs used, 0 if the ring is empty.
+ */
+int ring_data_iov(const Ring *ring, struct iovec iov[2]);
+
+/**
+ * @brief Marks bytes written to the free part as used.
+ *
+ * @param Ring* Pointer to a ring.
+ * @param size_t Number of bytes, at most "ring_space".
+ * @return Void
+ */
+void ring_produce(Ring *ring, size_t n);
+
+/**
+ * @brief Copies bytes into the ring.
+ *
+ * @param Ring* Pointer to a ring.
+ * @param Void* The bytes.
+ * @param size_t Number of bytes.
+ * @return Bool False, and nothing copied, if the bytes do not fit.
+ */
+bool ring_write(Ring *ring, const void *data, size_t n);
+
+/**
+ * @brief Moves the bytes to a new data array of another capacity.
+ *
+ * The bytes start at the beginning of the new array, so nothing wraps.
+ * @param Ring* Pointer to a ring.
+ * @param size_t The new capacity, a power of two and at least "ring_length".
+ * @return Bool False, and the ring unchanged, if out of memory.
+ */
+bool ring_resize(Ring *ring, size_t capacity);
+
+/**
+ * @brief Drops bytes from the tail so that "length" bytes remain.
+ *
+ * @param Ring* Pointer to a ring.
+ * @param size_t The new length, at most "ring_length".
+ * @return Void
+ */
+void ring_truncate(Ring *ring, size_t length);
+
+/**
+ * @brief Gets the first bytes of the ring as one contiguous block.
+ *
+ * Points into the ring unless the bytes wrap around its end, then they are
+ * copied to "scratch" and scratch is returned.
+ *
+ * @param Ring* Pointer to a ring.
+ * @param size_t Number of bytes, at most "ring_length".
+ * @param unsigned char* A buffer of at least "n" bytes.
+ * @return unsigned char* The bytes.
+ */
+unsigned char *ring_peek(Ring *ring, size_t n, unsigned char *scratch);
+
+/**
+ * @brief Drops bytes from the head of the ring.
+ *
+ * @param Ring* Pointer to a ring.
+ * @param size_t Number of bytes, at most "ring_length".
+ * @return Void
+ */
+void ring_consume(Ring *ring, size_t n);
+
+/**
+ * @}
+ */
+
+#endif /* RING_H */
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "ring.h"
+
+#define CAPACITY 16
+
+// Write and consume across the end of the ring and verify the bytes.
+static bool verify_wrap(Ring *ring)
+{
+    unsigned char scratch[CAPACITY];
+    bool correct = true;
+
+    ring_write(ring, "0123456789", 10);
+    ring_consume(ring, 8);
+    ring_write(ring, "abcdefghij", 10);
+
+    // "89abcdefghij" now wraps around the end of the data array.
+    unsigned char *bytes = ring_peek(ring, 12, scratch);
+    if (ring_length(ring) != 12 || memcmp(bytes, "89abcdefghij", 12) != 0 || bytes != scratch)
+    {
+        correct = false;
+    }
+
+    if (ring_at(ring, 0) != '8' || ring_at(ring, 11) != 'j')
+    {
+        correct = false;
+    }
+
+    ring_consume(ring, 12);
+    return correct && ring_length(ring) == 0;
+}
+
+// Verify that the free and used parts are described by two iovecs.
+static bool verify_iov(Ring *ring)
+{
+    struct iovec iov[2];
+    bool correct = true;
+
+    ring_write(ring, "0123456789", 10);
+    ring_consume(ring, 6);
+
+    // Fill the free space as a read would.
+    int count = ring_free_iov(ring, iov);
+    size_t space = 0;
+    for (int i = 0; i < count; i++)
+    {
+        memset(iov[i].iov_base, 'x', iov[i].iov_len);
+        space += iov[i].iov_len;
+    }
+    ring_produce(ring, space);
+
+    if (count != 2 || space != CAPACITY - 4 || ring_space(ring) != 0 || ring_write(ring, "y", 1))
+    {
+        correct = false;
+    }
+
+    count = ring_data_iov(ring, iov);
+    if (count != 2 || iov[0].iov_len + iov[1].iov_len != CAPACITY)
+    {
+        correct = false;
+    }
+
+    // Drop everything but "6789".
+    ring_truncate(ring, 4);
+    unsigned char scratch[CAPACITY];
+    if (memcmp(ring_peek(ring, 4, scratch), "6789", 4) != 0)
+    {
+        correct = false;
+    }
+
+    ring_clear(ring);
+    return correct && ring_length(ring) == 0;
+}
+
+// Grow a full, wrapped ring and shrink it back, the bytes must stay in order.
+static bool verify_resize(Ring *ring)
+{
+    bool correct = true;
+
+    ring_write(ring, "0123456789", 10);
+    ring_consume(ring, 6);
+    ring_write(ring, "abcdefghijkl", 12);
+
+    if (!ring_resize(ring, 2 * CAPACITY) || ring->capacity != 2 * CAPACITY || ring_space(ring) != CAPACITY)
+    {
+        correct = false;
+    }
+
+    ring_write(ring, "mnop", 4);
+    unsigned char scratch[2 * CAPACITY];
+    if (ring_length(ring) != 20 || memcmp(ring_peek(ring, 20, scratch), "6789abcdefghijklmnop", 20) != 0)
+    {
+        correct = false;
+    }
+
+    ring_consume(ring, 12);
+    if (!ring_resize(ring, CAPACITY) || ring_length(ring) != 8 || memcmp(ring_peek(ring, 8, scratch), "ijklmnop", 8) != 0)
+    {
+        correct = false;
+    }
+
+    ring_clear(ring);
+    return correct && ring->capacity == CAPACITY;
+}
+
+// Test program.
+int main(void)
+{
+    Ring *ring = ring_create(CAPACITY);
+
+    bool wrap_ok = verify_wrap(ring);
+    printf("Test reading across the end of the ring ... %s\n", wrap_ok ? "PASS" : "FAIL");
+
+    bool iov_ok = verify_iov(ring);
+    printf("Test free and used iovecs ... %s\n", iov_ok ? "PASS" : "FAIL");
+
+    bool resize_ok = verify_resize(ring);
+    printf("Test growing and shrinking the ring ... %s\n", resize_ok ? "PASS" : "FAIL");
+
+    ring_destroy(ring);
+
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include "store.h"
+
+static size_t filter_size(size_t length);
+
+//(The user has to free up memory.)
+Store *store_create(void)
+{
+    Store *store = calloc(1, sizeof(Store));
+    store->filter = bloom_create(STORE_FILTER_MIN);
+    store->memory = sizeof(Store) + bloom_memory_usage(store->filter);
+    return store;
+}
+
+//(FREEING UP MEMORY.)
+void store_destroy(Store *store)
+{
+    for (int i = 0; i < HASH_BUCKETS; i++)
+    {
+        if (store->buckets[i] != NULL)
+        {
+            table_destroy(store->buckets[i]);
+        }
+    }
+
+    bloom_destroy(store->filter);
+    free(store);
+}
+
+size_t store_get_length(const Store *store)
+{
+    return store->length;
+}
+
+size_t store_memory_usage(const Store *store)
+{
+    return store->memory;
+}
+
+TablePos store_insert(Store *store, const char *ssn, const char *email, const char *name)
+{
+    hash_t bucket = hash_ssn((char *)ssn);
+    if (store->buckets[bucket] == NULL)
+    {
+        store->buckets[bucket] = table_create();
+        store->memory += table_memory_usage(store->buckets[bucket]);
+    }
+
+    Table *tbl = store->buckets[bucket];
+    size_t length = table_get_length(tbl);
+    size_t memory = table_memory_usage(tbl);
+    TablePos pos = table_insert(tbl, ssn, email, name);
+    store->length += table_get_length(tbl) - length;
+    store->memory += table_memory_usage(tbl) - memory;
+
+    //A replaced entry is in the filter already
+    if (table_get_length(tbl) != length)
+    {
+        bloom_add(store->filter, ssn);
+        if (store->length * STORE_FILTER_COUNTERS > store->filter->count)
+        {
+            store_rebuild_filter(store);
+        }
+    }
+
+    return pos;
+}
+
+bool store_find(Store *store, const char *ssn, TablePos *pos)
+{
+    Table *tbl = store->buckets[hash_ssn((char *)ssn)];
+    if (tbl == NULL || !bloom_may_contain(store->filter, ssn))
+    {
+        return false;
+    }
+
+    *pos = table_find(tbl, ssn);
+    return !table_pos_equal(*pos, table_end(tbl));
+}
+
+//(FREEING UP MEMORY.)
+bool store_erase(Store *store, const char *ssn)
+{
+    Table *tbl = store->buckets[hash_ssn((char *)ssn)];
+    if (tbl == NULL || !table_erase(tbl, ssn))
+    {
+        return false;
+    }
+
+    store->length--;
+    bloom_remove(store->filter, ssn);
+    return true;
+}
+
+Table *store_bucket(Store *store, hash_t bucket)
+{
+    return store->buckets[bucket];
+}
+
+Table *store_detach(Store *store, hash_t bucket)
+{
+    Table *tbl = store->buckets[bucket];
+    if (tbl != NULL)
+    {
+        store->length -= table_get_length(tbl);
+        store->memory -= table_memory_usage(tbl);
+        store->buckets[bucket] = NULL;
+    }
+
+    return tbl;
+}
+
+void store_rebuild_filter(Store *store)
+{
+    Bloom *filter = bloom_create(filter_size(store->length));
+    if (filter == NULL)
+    {
+        return;
+    }
+
+    for (int i = 0; i < HASH_BUCKETS; i++)
+    {
+        Table *tbl = store->buckets[i];
+        if (tbl == NULL)
+        {
+            continue;
+        }
+        for (TablePos pos = table_first(tbl); !table_pos_equal(pos, table_end(tbl)); pos = table_next(pos))
+        {
+            bloom_add(filter, table_inspect_ssn(pos));
+        }
+    }
+
+    store->memory += bloom_memory_usage(filter) - bloom_memory_usage(store->filter);
+    bloom_destroy(store->filter);
+    store->filter = filter;
+}
+
+// The smallest power of two with STORE_FILTER_COUNTERS counters per entry
+static size_t filter_size(size_t length)
+{
+    size_t count = STORE_FILTER_MIN;
+    while (count < length * STORE_FILTER_COUNTERS)
+    {
+        count *= 2;
+    }
+    return count;
+}
@@ -0,0 +1,151 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "bloom.h"
+#include "hash.h"
+#include "table.h"
+
+/**
+ * @defgroup store store.h
+ * @brief The header file for the functions used in the entry store.
+ * The store keeps one table per hash bucket, so all entries with the same
+ * "hash_ssn" live in the same table. A range of buckets can then be handed
+ * over to another node by detaching whole tables, without hashing any of
+ * the entries again. Tables are only created for buckets that are used.
+ * A counting Bloom filter over all ssns lets most lookups of an unknown
+ * ssn return without probing a table.
+ *
+ * @{
+ */
+
+#define STORE_FILTER_COUNTERS 8
+#define STORE_FILTER_MIN 1024
+
+/**
+ * @brief The structure for a "store".
+ *
+ * "buckets" holds a table per hash value, or NULL if the bucket has never
+ * been used. "length" is the total number of entries in all buckets and
+ * "memory" the bytes held by their tables and the filter. "filter" has
+ * STORE_FILTER_COUNTERS counters per entry, or more, and is rebuilt twice
+ * as large when the entries outgrow it.
+ */
+typedef struct store
+{
+    Table *buckets[HASH_BUCKETS];
+    Bloom *filter;
+    size_t length;
+    size_t memory;
+} Store;
+
+/**
+ * @brief Creates a store.
+ *
+ * <b>OBS</b>: The user has to free up memory with "store_destroy".
+ * @param Void
+ * @return *Store A pointer to the empty store.
+ */
+Store *store_create(void);
+
+/**
+ * @brief Deallocate the store and all of its tables.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ * @param Store* Pointer to a store.
+ * @return Void
+ */
+void store_destroy(Store *store);
+
+/**
+ * @brief Returns the number of entries in the store.
+ *
+ * @param Store* A pointer to the store.
+ * @return size_t Number of entries, in constant time.
+ */
+size_t store_get_length(const Store *store);
+
+/**
+ * @brief Returns the number of bytes held by the store.
+ *
+ * Includes the slot arrays and slabs of every table, so dividing by the
+ * number of entries gives the cost of an entry on this host.
+ *
+ * @param Store* A pointer to the store.
+ * @return size_t Bytes used by the store, in constant time.
+ */
+size_t store_memory_usage(const Store *store);
+
+/**
+ * @brief Inserts or replaces the entry for the given ssn.
+ *
+ * @param Store* A pointer to the store.
+ * @param Char* The social security number.
+ * @param Char* The email to store.
+ * @param Char* The name to store.
+ * @return TablePos The position of the entry in its bucket.
+ */
+TablePos store_insert(Store *store, const char *ssn, const char *email, const char *name);
+
+/**
+ * @brief Finds the entry for the given ssn.
+ *
+ * @param Store* A pointer to the store.
+ * @param Char* The social security number.
+ * @param TablePos* Set to the position of the entry if found.
+ * @return Bool True if the entry was found.
+ */
+bool store_find(Store *store, const char *ssn, TablePos *pos);
+
+/**
+ * @brief Removes the entry for the given ssn.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ *
+ * @param Store* A pointer to the store.
+ * @param Char* The social security number.
+ * @return Bool True if an entry was removed.
+ */
+bool store_erase(Store *store, const char *ssn);
+
+/**
+ * @brief Gets the table of a bucket.
+ *
+ * @param Store* A pointer to the store.
+ * @param hash_t The bucket.
+ * @return Table* The table of the bucket, or NULL if it is empty.
+ */
+Table *store_bucket(Store *store, hash_t bucket);
+
+/**
+ * @brief Detaches the table of a bucket from the store.
+ *
+ * The store forgets the bucket and the caller takes over the table. The
+ * filter still holds the ssns of the bucket until "store_rebuild_filter",
+ * which only makes lookups of them probe for nothing.
+ *
+ * <b>OBS</b>: The user has to free the returned table with "table_destroy".
+ *
+ * @param Store* A pointer to the store.
+ * @param hash_t The bucket.
+ * @return Table* The detached table, or NULL if the bucket was empty.
+ */
+Table *store_detach(Store *store, hash_t bucket);
+
+/**
+ * @brief Rebuilds the filter from the entries in the store.
+ *
+ * Drops what detached buckets left behind and sizes the filter for the
+ * entries there are now. Keeps the old filter if out of memory.
+ *
+ * @param Store* A pointer to the store.
+ * @return Void
+ */
+void store_rebuild_filter(Store *store);
+
+/**
+ * @}
+ */
+
+#endif /* STORE_H */
@@ -0,0 +1,317 @@
+#include <stdlib.h>
+#include <string.h>
+#include "table.h"
+
+#define TABLE_MIN_CAPACITY 64
+
+/**
+ * @defgroup table_static Static_Table
+ *
+ * @brief "table.c" contains the functions used to make an open-addressing
+ * hash table. The table uses dynamic memory, use it with caution.
+ *
+ * @{
+ */
+
+/**
+ * @brief Hashes a key.
+ *
+ * FNV-1a over the TABLE_KEY_LENGTH bytes of the key.
+ *
+ * @param Char* The key.
+ * @return uint64_t The hash of the key.
+ */
+static uint64_t hash_key(const char *ssn)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < TABLE_KEY_LENGTH; i++)
+    {
+        hash ^= (unsigned char)ssn[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Copies a string into a block from the pool.
+ *
+ * @param Pool* The pool.
+ * @param Char* The string to be copied.
+ * @param uint8_t* Set to the length of the copy.
+ * @return Char* A null terminated copy of at most 255 characters.
+ */
+static char *clone_string(Pool *pool, const char *in, uint8_t *length)
+{
+    size_t len = strnlen(in, UINT8_MAX);
+    char *out = pool_alloc(pool, len + 1);
+    memcpy(out, in, len);
+    out[len] = '\0';
+    *length = len;
+    return out;
+}
+
+/**
+ * @brief Returns the strings of an entry to the pool.
+ *
+ * @param Pool* The pool.
+ * @param table_entry* The entry.
+ * @return Void
+ */
+static void free_strings(Pool *pool, struct table_entry *entry)
+{
+    pool_free(pool, entry->email, entry->emailLength + 1);
+    pool_free(pool, entry->name, entry->nameLength + 1);
+}
+
+/**
+ * @brief Finds the slot holding the key.
+ *
+ * @param Table* The table.
+ * @param Char* The key.
+ * @param uint64_t The hash of the key.
+ * @return size_t The index of the slot, or the capacity if not found.
+ */
+static size_t find_slot(const Table *tbl, const char *ssn, uint64_t hash)
+{
+    size_t mask = tbl->capacity - 1;
+    size_t index = hash & mask;
+
+    while (tbl->slots[index].entry != NULL || tbl->slots[index].tombstone)
+    {
+        struct table_slot *slot = &tbl->slots[index];
+        if (slot->entry != NULL && slot->hash == hash &&
+            memcmp(slot->entry->ssn, ssn, TABLE_KEY_LENGTH) == 0)
+        {
+            return index;
+        }
+        index = (index + 1) & mask;
+    }
+
+    return tbl->capacity;
+}
+
+/**
+ * @brief Rebuilds the slot array with the given capacity.
+ *
+ * Drops all tombstones. Entries themselves are not reallocated.
+ *
+ * @param Table* The table.
+ * @param size_t The new capacity, a power of two.
+ * @return Void
+ */
+static void rehash(Table *tbl, size_t capacity)
+{
+    struct table_slot *old = tbl->slots;
+    size_t oldCapacity = tbl->capacity;
+
+    tbl->slots = calloc(capacity, sizeof(struct table_slot));
+    tbl->capacity = capacity;
+    tbl->tombstones = 0;
+
+    for (size_t i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].entry != NULL)
+        {
+            size_t index = old[i].hash & (capacity - 1);
+            while (tbl->slots[index].entry != NULL)
+            {
+                index = (index + 1) & (capacity - 1);
+            }
+            tbl->slots[index] = old[i];
+        }
+    }
+
+    free(old);
+}
+
+/**
+ * @brief Skips forward to the next slot in use.
+ *
+ * @param TablePos A position.
+ * @return TablePos The first position at or after "pos" holding an entry.
+ */
+static TablePos skip_empty(TablePos pos)
+{
+    while (pos.index < pos.table->capacity && pos.table->slots[pos.index].entry == NULL)
+    {
+        pos.index++;
+    }
+    return pos;
+}
+
+/**
+ * @}
+ */
+
+//(The user has to free up memory.)
+Table *table_create(void)
+{
+    Table *tbl = malloc(sizeof(Table));
+    tbl->slots = calloc(TABLE_MIN_CAPACITY, sizeof(struct table_slot));
+    tbl->pool = pool_create();
+    tbl->capacity = TABLE_MIN_CAPACITY;
+    tbl->length = 0;
+    tbl->tombstones = 0;
+
+    return tbl;
+}
+
+//(FREEING UP MEMORY.)
+void table_destroy(Table *tbl)
+{
+    pool_destroy(tbl->pool);
+    free(tbl->slots);
+    free(tbl);
+}
+
+bool table_is_empty(const Table *tbl)
+{
+    return tbl->length == 0;
+}
+
+size_t table_get_length(const Table *tbl)
+{
+    return tbl->length;
+}
+
+size_t table_memory_usage(const Table *tbl)
+{
+    return sizeof(Table) + sizeof(Pool) + tbl->capacity * sizeof(struct table_slot) + pool_reserved(tbl->pool);
+}
+
+TablePos table_first(Table *tbl)
+{
+    TablePos pos = {
+        .table = tbl,
+        .index = 0};
+
+    return skip_empty(pos);
+}
+
+TablePos table_end(Table *tbl)
+{
+    TablePos pos = {
+        .table = tbl,
+        .index = tbl->capacity};
+
+    return pos;
+}
+
+bool table_pos_equal(TablePos p1, TablePos p2)
+{
+    return p1.table == p2.table && p1.index == p2.index;
+}
+
+TablePos table_next(TablePos pos)
+{
+    pos.index++;
+    return skip_empty(pos);
+}
+
+TablePos table_insert(Table *tbl, const char *ssn, const char *email, const char *name)
+{
+    uint64_t hash = hash_key(ssn);
+    size_t index = find_slot(tbl, ssn, hash);
+    TablePos pos = {.table = tbl};
+
+    if (index != tbl->capacity)
+    {
+        // Key already stored, replace the values.
+        struct table_entry *entry = tbl->slots[index].entry;
+        free_strings(tbl->pool, entry);
+        entry->email = clone_string(tbl->pool, email, &entry->emailLength);
+        entry->name = clone_string(tbl->pool, name, &entry->nameLength);
+
+        pos.index = index;
+        return pos;
+    }
+
+    // Keep the load (entries and tombstones) below 3/4.
+    if ((tbl->length + tbl->tombstones + 1) * 4 > tbl->capacity * 3)
+    {
+        size_t capacity = tbl->capacity;
+        while ((tbl->length + 1) * 2 > capacity)
+        {
+            capacity *= 2;
+        }
+        rehash(tbl, capacity);
+    }
+
+    struct table_entry *entry = pool_alloc(tbl->pool, sizeof(struct table_entry));
+    memcpy(entry->ssn, ssn, TABLE_KEY_LENGTH);
+    entry->ssn[TABLE_KEY_LENGTH] = '\0';
+    entry->email = clone_string(tbl->pool, email, &entry->emailLength);
+    entry->name = clone_string(tbl->pool, name, &entry->nameLength);
+
+    // Take the first free slot, reusing tombstones.
+    index = hash & (tbl->capacity - 1);
+    while (tbl->slots[index].entry != NULL)
+    {
+        index = (index + 1) & (tbl->capacity - 1);
+    }
+    if (tbl->slots[index].tombstone)
+    {
+        tbl->tombstones--;
+    }
+
+    tbl->slots[index] = (struct table_slot){
+        .hash = hash,
+        .entry = entry,
+        .tombstone = false};
+    tbl->length++;
+
+    pos.index = index;
+    return pos;
+}
+
+TablePos table_find(Table *tbl, const char *ssn)
+{
+    TablePos pos = {
+        .table = tbl,
+        .index = find_slot(tbl, ssn, hash_key(ssn))};
+
+    return pos;
+}
+
+//(FREEING UP MEMORY.)
+bool table_erase(Table *tbl, const char *ssn)
+{
+    TablePos pos = table_find(tbl, ssn);
+    if (table_pos_equal(pos, table_end(tbl)))
+    {
+        return false;
+    }
+
+    table_remove(pos);
+    return true;
+}
+
+//(FREEING UP MEMORY.)
+TablePos table_remove(TablePos pos)
+{
+    struct table_slot *slot = &pos.table->slots[pos.index];
+
+    free_strings(pos.table->pool, slot->entry);
+    pool_free(pos.table->pool, slot->entry, sizeof(struct table_entry));
+    slot->entry = NULL;
+    slot->tombstone = true;
+    pos.table->length--;
+    pos.table->tombstones++;
+
+    return table_next(pos);
+}
+
+const char *table_inspect_ssn(TablePos pos)
+{
+    return pos.table->slots[pos.index].entry->ssn;
+}
+
+const char *table_inspect_email(TablePos pos)
+{
+    return pos.table->slots[pos.index].entry->email;
+}
+
+const char *table_inspect_name(TablePos pos)
+{
+    return pos.table->slots[pos.index].entry->name;
+}
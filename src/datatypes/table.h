@@ -0,0 +1,237 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include "pool.h"
+
+#define TABLE_KEY_LENGTH 12
+
+/**
+ * @defgroup table table.h
+ * @brief The header file for the functions used in the hash table.
+ * The table is an open-addressing hash table with linear probing, keyed by
+ * the 12 byte social security number. Each key is stored at most once, so
+ * inserting an existing key replaces its name and email. Dynamic memory is
+ * used in these following functions so the user has to be cautious with
+ * memory usage.
+ *
+ * @{
+ */
+
+/**
+ * @brief The structure for an "entry".
+ *
+ * The structure holds the key "ssn" inline as a null terminated string
+ * together with the "email" and "name" stored under it. The entry and both
+ * strings are blocks from the pool of the table.
+ */
+struct table_entry
+{
+    char ssn[TABLE_KEY_LENGTH + 1];
+    uint8_t emailLength;
+    uint8_t nameLength;
+    char *email;
+    char *name;
+};
+
+/**
+ * @brief The structure for a "slot".
+ *
+ * A slot is either empty (entry is NULL and tombstone is false), a
+ * tombstone left behind by a removed entry, or in use. The full hash of
+ * the key is cached so probing rarely has to compare keys.
+ */
+struct table_slot
+{
+    uint64_t hash;
+    struct table_entry *entry;
+    bool tombstone;
+};
+
+/**
+ * @brief The structure for a "table".
+ *
+ * "capacity" is always a power of two. "length" counts the entries in use
+ * and "tombstones" the removed slots that still break probe chains. Entries
+ * and their strings are allocated from "pool".
+ */
+typedef struct table
+{
+    struct table_slot *slots;
+    Pool *pool;
+    size_t capacity;
+    size_t length;
+    size_t tombstones;
+} Table;
+
+/**
+ * @brief The struct for a "table_pos".
+ *
+ * The structure refers to a slot in the table. Positions are only valid
+ * until the next insert, since an insert may grow the table.
+ */
+typedef struct table_pos
+{
+    Table *table;
+    size_t index;
+} TablePos;
+
+/**
+ * @brief Creates a table.
+ *
+ * <b>OBS</b>: The user has to free up memory with "table_destroy".
+ * @param Void
+ * @return *Table A pointer to the empty table.
+ */
+Table *table_create(void);
+
+/**
+ * @brief Deallocate the table.
+ *
+ * Deallocate the table and all of its entries by releasing the slabs of
+ * its pool, without visiting the entries.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ * @param Table* Pointer to a table.
+ * @return Void
+ */
+void table_destroy(Table *tbl);
+
+/**
+ * @brief Checks if the table is empty.
+ *
+ * @param Table* A pointer to the table.
+ * @return Bool True if the table is empty.
+ */
+bool table_is_empty(const Table *tbl);
+
+/**
+ * @brief Returns the number of entries in the table.
+ *
+ * @param Table* A pointer to the table.
+ * @return size_t Number of entries, in constant time.
+ */
+size_t table_get_length(const Table *tbl);
+
+/**
+ * @brief Returns the number of bytes the table holds.
+ *
+ * Counts the slot array and the slabs of the pool.
+ *
+ * @param Table* A pointer to the table.
+ * @return size_t Bytes used by the table, in constant time.
+ */
+size_t table_memory_usage(const Table *tbl);
+
+/**
+ * @brief Gets the position of the first entry.
+ *
+ * Entries are visited in slot order, which is unrelated to insertion order.
+ *
+ * @param Table* A pointer to the table.
+ * @return TablePos The position of the first entry, or "table_end".
+ */
+TablePos table_first(Table *tbl);
+
+/**
+ * @brief Get the position <b>after</b> the last entry.
+ *
+ * @param Table* A pointer to the table.
+ * @return TablePos The position after the last slot.
+ */
+TablePos table_end(Table *tbl);
+
+/**
+ * @brief Check equality between two positions.
+ *
+ * @param TablePos The first position.
+ * @param TablePos The second position.
+ * @return Bool Returns true if the positions are equal, else false.
+ */
+bool table_pos_equal(TablePos p1, TablePos p2);
+
+/**
+ * @brief Goes to the position of the next entry.
+ *
+ * @param TablePos The current position.
+ * @return TablePos The position of the next entry, or "table_end".
+ */
+TablePos table_next(TablePos pos);
+
+/**
+ * @brief Inserts or replaces the entry for the given ssn.
+ *
+ * Only the first TABLE_KEY_LENGTH characters of "ssn" are used as key, and
+ * at most 255 characters of the email and the name are stored.
+ *
+ * @param Table* A pointer to the table.
+ * @param Char* The social security number.
+ * @param Char* The email to store.
+ * @param Char* The name to store.
+ * @return TablePos The position of the entry.
+ */
+TablePos table_insert(Table *tbl, const char *ssn, const char *email, const char *name);
+
+/**
+ * @brief Finds the entry for the given ssn.
+ *
+ * @param Table* A pointer to the table.
+ * @param Char* The social security number.
+ * @return TablePos The position of the entry, or "table_end" if not found.
+ */
+TablePos table_find(Table *tbl, const char *ssn);
+
+/**
+ * @brief Removes the entry for the given ssn.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ *
+ * @param Table* A pointer to the table.
+ * @param Char* The social security number.
+ * @return Bool True if an entry was removed.
+ */
+bool table_erase(Table *tbl, const char *ssn);
+
+/**
+ * @brief Removes the entry at the given position.
+ *
+ * Removing never moves other entries, so it is safe while iterating.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ *
+ * @param TablePos The position of the entry.
+ * @return TablePos The position of the next entry, or "table_end".
+ */
+TablePos table_remove(TablePos pos);
+
+/**
+ * @brief Gets the social security number at that position.
+ *
+ * @param TablePos The position of the entry.
+ * @return Char The SSN of the person.
+ */
+const char *table_inspect_ssn(TablePos pos);
+
+/**
+ * @brief Gets the E-Mail at that position.
+ *
+ * @param TablePos The position of the entry.
+ * @return Char The email of the person.
+ */
+const char *table_inspect_email(TablePos pos);
+
+/**
+ * @brief Gets the name at that position.
+ *
+ * @param TablePos The position of the entry.
+ * @return Char The name of the person.
+ */
+const char *table_inspect_name(TablePos pos);
+
+/**
+ * @}
+ */
+
+#endif /* TABLE_H */
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "table.h"
+
+#define NO_ENTRIES 1000
+
+// Write the 12 character ssn for index i.
+static void make_ssn(char *ssn, int i)
+{
+    snprintf(ssn, TABLE_KEY_LENGTH + 1, "%012d", i * 7919);
+}
+
+// Populate the table with NO_ENTRIES entries.
+static void add_values(Table *tbl)
+{
+    char ssn[TABLE_KEY_LENGTH + 1];
+    char email[32];
+    char name[32];
+
+    for (int i = 0; i < NO_ENTRIES; i++)
+    {
+        make_ssn(ssn, i);
+        snprintf(email, sizeof(email), "test%d@hotmail.com", i);
+        snprintf(name, sizeof(name), "mert%d", i);
+        table_insert(tbl, ssn, email, name);
+    }
+}
+
+// Look up every entry and verify its values.
+static bool verify_find(Table *tbl)
+{
+    char ssn[TABLE_KEY_LENGTH + 1];
+    char email[32];
+    char name[32];
+
+    for (int i = 0; i < NO_ENTRIES; i++)
+    {
+        make_ssn(ssn, i);
+        snprintf(email, sizeof(email), "test%d@hotmail.com", i);
+        snprintf(name, sizeof(name), "mert%d", i);
+
+        TablePos pos = table_find(tbl, ssn);
+        if (table_pos_equal(pos, table_end(tbl)) ||
+            strcmp(ssn, table_inspect_ssn(pos)) != 0 ||
+            strcmp(email, table_inspect_email(pos)) != 0 ||
+            strcmp(name, table_inspect_name(pos)) != 0)
+        {
+            return false;
+        }
+    }
+
+    return table_get_length(tbl) == NO_ENTRIES;
+}
+
+// Insert an existing key again and verify it is replaced, not duplicated.
+static bool verify_replace(Table *tbl)
+{
+    char ssn[TABLE_KEY_LENGTH + 1];
+    make_ssn(ssn, 7);
+    table_insert(tbl, ssn, "new@hotmail.com", "new");
+
+    TablePos pos = table_find(tbl, ssn);
+    return table_get_length(tbl) == NO_ENTRIES &&
+           strcmp(table_inspect_name(pos), "new") == 0;
+}
+
+// Remove every odd entry while iterating and verify the rest remain.
+static bool verify_remove(Table *tbl)
+{
+    int visited = 0;
+    TablePos pos = table_first(tbl);
+
+    while (!table_pos_equal(pos, table_end(tbl)))
+    {
+        visited++;
+        int value = 0;
+        sscanf(table_inspect_ssn(pos), "%d", &value);
+        if ((value / 7919) % 2 == 1)
+        {
+            pos = table_remove(pos);
+        }
+        else
+        {
+            pos = table_next(pos);
+        }
+    }
+
+    char ssn[TABLE_KEY_LENGTH + 1];
+    for (int i = 0; i < NO_ENTRIES; i++)
+    {
+        make_ssn(ssn, i);
+        bool found = !table_pos_equal(table_find(tbl, ssn), table_end(tbl));
+        if (found != (i % 2 == 0))
+        {
+            return false;
+        }
+    }
+
+    return visited == NO_ENTRIES && table_get_length(tbl) == NO_ENTRIES / 2;
+}
+
+// Erase the remaining entries by key.
+static bool verify_erase(Table *tbl)
+{
+    char ssn[TABLE_KEY_LENGTH + 1];
+    bool correct = true;
+
+    for (int i = 0; i < NO_ENTRIES; i++)
+    {
+        make_ssn(ssn, i);
+        if (table_erase(tbl, ssn) != (i % 2 == 0))
+        {
+            correct = false;
+        }
+    }
+
+    return correct && table_is_empty(tbl);
+}
+
+// Test program.
+int main(void)
+{
+    // Create an empty table.
+    Table *tbl = table_create();
+
+    // Add some values.
+    add_values(tbl);
+    bool find_ok = verify_find(tbl);
+    printf("Test lookup of all entries ... %s\n", find_ok ? "PASS" : "FAIL");
+
+    bool replace_ok = verify_replace(tbl);
+    printf("Test replacement of an existing key ... %s\n", replace_ok ? "PASS" : "FAIL");
+
+    bool remove_ok = verify_remove(tbl);
+    printf("Test removal while iterating ... %s\n", remove_ok ? "PASS" : "FAIL");
+
+    bool erase_ok = verify_erase(tbl);
+    printf("Test erasing by key ... %s\n", erase_ok ? "PASS" : "FAIL");
+
+    // Reuse the tombstoned table.
+    add_values(tbl);
+    bool reuse_ok = verify_find(tbl);
+    printf("Test reinsertion after erase ... %s\n", reuse_ok ? "PASS" : "FAIL");
+
+    // Clean up allocated resources.
+    table_destroy(tbl);
+
+    return 0;
+}
@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include "wheel.h"
+
+#define SLOT_MASK (WHEEL_SLOTS - 1)
+#define SPAN(level) ((uint64_t)1 << (WHEEL_BITS * (level)))
+
+static void place(Wheel *wheel, WheelTimer *timer, uint64_t base);
+static void link_timer(Wheel *wheel, WheelTimer *timer, int level, int slot);
+static void unlink_timer(Wheel *wheel, WheelTimer *timer);
+static void cascade(Wheel *wheel, uint64_t tick);
+static WheelTimer *expire(WheelTimer *expired, WheelTimer *list);
+static uint64_t rotate(uint64_t bits, int shift);
+
+//(The user has to free up memory.)
+Wheel *wheel_create(uint64_t now)
+{
+    Wheel *wheel = calloc(1, sizeof(Wheel));
+    if (wheel == NULL)
+    {
+        return NULL;
+    }
+
+    wheel->now = now;
+    return wheel;
+}
+
+//(FREEING UP MEMORY.)
+void wheel_destroy(Wheel *wheel)
+{
+    free(wheel);
+}
+
+void wheel_timer_init(WheelTimer *timer)
+{
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->deadline = 0;
+    timer->level = -1;
+    timer->slot = 0;
+}
+
+bool wheel_armed(const WheelTimer *timer)
+{
+    return timer->level >= 0;
+}
+
+void wheel_arm(Wheel *wheel, WheelTimer *timer, uint64_t deadline)
+{
+    wheel_cancel(wheel, timer);
+    timer->deadline = deadline;
+
+    //The slot of "now" has been handled, the earliest slot left is now + 1
+    place(wheel, timer, wheel->now + 1);
+}
+
+void wheel_cancel(Wheel *wheel, WheelTimer *timer)
+{
+    if (wheel_armed(timer))
+    {
+        unlink_timer(wheel, timer);
+        timer->level = -1;
+    }
+}
+
+WheelTimer *wheel_advance(Wheel *wheel, uint64_t now)
+{
+    WheelTimer *expired = expire(NULL, wheel->due);
+    wheel->due = NULL;
+
+    while (wheel->now < now)
+    {
+        if (wheel->occupied[0] == 0)
+        {
+            //Nothing expires before level 0 is refilled at the next boundary
+            uint64_t boundary = (wheel->now | SLOT_MASK) + 1;
+            if (boundary > now)
+            {
+                wheel->now = now;
+                break;
+            }
+            wheel->now = boundary;
+        }
+        else
+        {
+            wheel->now++;
+        }
+
+        uint64_t tick = wheel->now;
+        if ((tick & SLOT_MASK) == 0)
+        {
+            cascade(wheel, tick);
+        }
+
+        int slot = tick & SLOT_MASK;
+        expired = expire(expired, wheel->slots[0][slot]);
+        wheel->slots[0][slot] = NULL;
+        wheel->occupied[0] &= ~((uint64_t)1 << slot);
+    }
+
+    //Timers cascaded onto a tick that was already passed
+    expired = expire(expired, wheel->due);
+    wheel->due = NULL;
+
+    return expired;
+}
+
+uint64_t wheel_next_expiry(const Wheel *wheel)
+{
+    if (wheel->due != NULL)
+    {
+        return wheel->now;
+    }
+
+    uint64_t next = WHEEL_NEVER;
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+    {
+        if (wheel->occupied[level] == 0)
+        {
+            continue;
+        }
+
+        //First slot of the level that the wheel has not turned past yet
+        uint64_t first = level == 0 ? wheel->now + 1 : (wheel->now >> (WHEEL_BITS * level)) + 1;
+        uint64_t offset = __builtin_ctzll(rotate(wheel->occupied[level], first & SLOT_MASK));
+        uint64_t tick = level == 0 ? first + offset : (first + offset) << (WHEEL_BITS * level);
+
+        if (tick < next)
+        {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+// Put the timer in the lowest level whose slots reach its deadline, counted
+// from "base", the first tick that has not been handled yet
+static void place(Wheel *wheel, WheelTimer *timer, uint64_t base)
+{
+    if (timer->deadline < base)
+    {
+        link_timer(wheel, timer, WHEEL_LEVELS, 0);
+        return;
+    }
+
+    uint64_t delta = timer->deadline - base;
+    uint64_t tick = timer->deadline;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= SPAN(level + 1))
+    {
+        level++;
+    }
+
+    //Beyond the last level, wait in its farthest slot and be placed again
+    if (delta >= SPAN(WHEEL_LEVELS))
+    {
+        tick = base + SPAN(WHEEL_LEVELS) - 1;
+    }
+
+    link_timer(wheel, timer, level, (tick >> (WHEEL_BITS * level)) & SLOT_MASK);
+}
+
+static void link_timer(Wheel *wheel, WheelTimer *timer, int level, int slot)
+{
+    WheelTimer **head = level == WHEEL_LEVELS ? &wheel->due : &wheel->slots[level][slot];
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = *head;
+    if (*head != NULL)
+    {
+        (*head)->prev = timer;
+    }
+    *head = timer;
+
+    if (level < WHEEL_LEVELS)
+    {
+        wheel->occupied[level] |= (uint64_t)1 << slot;
+    }
+}
+
+static void unlink_timer(Wheel *wheel, WheelTimer *timer)
+{
+    WheelTimer **head = timer->level == WHEEL_LEVELS ? &wheel->due : &wheel->slots[timer->level][timer->slot];
+
+    if (timer->prev != NULL)
+    {
+        timer->prev->next = timer->next;
+    }
+    else
+    {
+        *head = timer->next;
+    }
+    if (timer->next != NULL)
+    {
+        timer->next->prev = timer->prev;
+    }
+
+    if (timer->level < WHEEL_LEVELS && *head == NULL)
+    {
+        wheel->occupied[timer->level] &= ~((uint64_t)1 << timer->slot);
+    }
+}
+
+// Move the timers of the higher level slots starting at "tick" down, the
+// highest level first so its timers can move down more than one level
+static void cascade(Wheel *wheel, uint64_t tick)
+{
+    int top = 1;
+    while (top < WHEEL_LEVELS - 1 && (tick & (SPAN(top + 1) - 1)) == 0)
+    {
+        top++;
+    }
+
+    for (int level = top; level > 0; level--)
+    {
+        int slot = (tick >> (WHEEL_BITS * level)) & SLOT_MASK;
+        WheelTimer *timer = wheel->slots[level][slot];
+        wheel->slots[level][slot] = NULL;
+        wheel->occupied[level] &= ~((uint64_t)1 << slot);
+
+        while (timer != NULL)
+        {
+            WheelTimer *next = timer->next;
+            place(wheel, timer, tick);
+            timer = next;
+        }
+    }
+}
+
+// Disarm the timers of "list" and put them in front of "expired"
+static WheelTimer *expire(WheelTimer *expired, WheelTimer *list)
+{
+    while (list != NULL)
+    {
+        WheelTimer *next = list->next;
+        list->level = -1;
+        list->prev = NULL;
+        list->next = expired;
+        expired = list;
+        list = next;
+    }
+
+    return expired;
+}
+
+static uint64_t rotate(uint64_t bits, int shift)
+{
+    return shift == 0 ? bits : (bits >> shift) | (bits << (64 - shift));
+}
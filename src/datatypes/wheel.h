@@ -0,0 +1,141 @@
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS) // Slots per level
+#define WHEEL_LEVELS 4                // Level l has slots of WHEEL_SLOTS^l ticks
+
+#define WHEEL_NEVER UINT64_MAX
+
+/**
+ * @defgroup wheel wheel.h
+ * @brief The header file for the functions used in the timer wheel.
+ * The wheel keeps timers with a deadline in ticks (ms in the node) in
+ * WHEEL_LEVELS levels of WHEEL_SLOTS slots. Level 0 has a slot per tick,
+ * every following level covers WHEEL_SLOTS times as much time per slot.
+ * A timer is put in the lowest level that reaches its deadline and moved
+ * down a level each time the wheel turns past the start of its slot, so
+ * arming and cancelling a timer only link or unlink it from a slot.
+ *
+ * The timers are owned by the user and only linked into the wheel, no
+ * memory is allocated per timer.
+ *
+ * @{
+ */
+
+/**
+ * @brief A timer, embedded in whatever it is the timer of.
+ *
+ * Only "deadline" is for the user to read, the rest belongs to the wheel.
+ */
+typedef struct wheel_timer
+{
+    struct wheel_timer *prev;
+    struct wheel_timer *next;
+    uint64_t deadline;
+    int8_t level; // -1 when not armed, WHEEL_LEVELS when already due
+    uint8_t slot;
+} WheelTimer;
+
+/**
+ * @brief The structure for a "wheel".
+ *
+ * "now" is the last tick the wheel was advanced to. "occupied" has a bit
+ * per slot of a level that holds timers, so the next expiry is found
+ * without looking at the timers themselves.
+ */
+typedef struct wheel
+{
+    uint64_t now;
+    WheelTimer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t occupied[WHEEL_LEVELS];
+    WheelTimer *due;
+} Wheel;
+
+/**
+ * @brief Creates an empty wheel.
+ *
+ * <b>OBS</b>: The user has to free up memory with "wheel_destroy".
+ * @param uint64_t The current tick.
+ * @return *Wheel A pointer to the wheel, or NULL if out of memory.
+ */
+Wheel *wheel_create(uint64_t now);
+
+/**
+ * @brief Deallocate the wheel. Armed timers are left as they are.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ * @param Wheel* Pointer to a wheel.
+ * @return Void
+ */
+void wheel_destroy(Wheel *wheel);
+
+/**
+ * @brief Prepares a timer for use, it is not armed.
+ *
+ * @param WheelTimer* Pointer to a timer.
+ * @return Void
+ */
+void wheel_timer_init(WheelTimer *timer);
+
+/**
+ * @brief Returns true if the timer is armed.
+ *
+ * @param WheelTimer* Pointer to a timer.
+ * @return Bool True until the timer expires or is cancelled.
+ */
+bool wheel_armed(const WheelTimer *timer);
+
+/**
+ * @brief Arms a timer, or moves the deadline of an armed timer.
+ *
+ * A deadline that has already passed expires on the next advance.
+ *
+ * @param Wheel* Pointer to a wheel.
+ * @param WheelTimer* Pointer to a timer.
+ * @param uint64_t The tick the timer expires at.
+ * @return Void
+ */
+void wheel_arm(Wheel *wheel, WheelTimer *timer, uint64_t deadline);
+
+/**
+ * @brief Cancels a timer, nothing happens if it is not armed.
+ *
+ * @param Wheel* Pointer to a wheel.
+ * @param WheelTimer* Pointer to a timer.
+ * @return Void
+ */
+void wheel_cancel(Wheel *wheel, WheelTimer *timer);
+
+/**
+ * @brief Turns the wheel to the given tick and takes out the expired timers.
+ *
+ * The expired timers are no longer armed and are returned as a list linked
+ * by "next", in no particular order.
+ *
+ * @param Wheel* Pointer to a wheel.
+ * @param uint64_t The current tick.
+ * @return WheelTimer* The first expired timer, or NULL if none expired.
+ */
+WheelTimer *wheel_advance(Wheel *wheel, uint64_t now);
+
+/**
+ * @brief Returns when the wheel next has to be advanced.
+ *
+ * That is the deadline of the first timer in level 0, or the tick a higher
+ * level moves its first timers down, whichever comes first. A timer in a
+ * higher level can expire later than the returned tick, never earlier.
+ *
+ * @param Wheel* Pointer to a wheel.
+ * @return uint64_t The tick, or WHEEL_NEVER if no timer is armed.
+ */
+uint64_t wheel_next_expiry(const Wheel *wheel);
+
+/**
+ * @}
+ */
+
+#endif /* WHEEL_H */
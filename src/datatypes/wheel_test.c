@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "wheel.h"
+
+#define TIMERS 2000
+#define HORIZON 20000000 // Past the last level, so timers are placed again
+
+// Arm timers far and near, cancel some, and verify that each of the others
+// expires on the first advance that reaches its deadline.
+static bool verify_expiry(void)
+{
+    static WheelTimer timers[TIMERS];
+    static bool cancelled[TIMERS];
+    bool correct = true;
+    uint64_t now = 1000;
+    Wheel *wheel = wheel_create(now);
+
+    srand(7);
+    for (int i = 0; i < TIMERS; i++)
+    {
+        wheel_timer_init(&timers[i]);
+        uint64_t delay = 1 + (i % 4 == 0 ? (uint64_t)rand() % 64 : (uint64_t)rand() % HORIZON);
+        wheel_arm(wheel, &timers[i], now + delay);
+        cancelled[i] = false;
+    }
+    for (int i = 0; i < TIMERS; i += 7)
+    {
+        wheel_cancel(wheel, &timers[i]);
+        cancelled[i] = true;
+    }
+
+    int fired = 0;
+    while (fired < TIMERS - (TIMERS + 6) / 7)
+    {
+        // The wheel may wake up early for a cascade, never late
+        uint64_t next = wheel_next_expiry(wheel);
+        for (int i = 0; i < TIMERS; i++)
+        {
+            if (wheel_armed(&timers[i]) && timers[i].deadline < next)
+            {
+                correct = false;
+            }
+        }
+
+        // Mix jumps to the next expiry with random steps
+        uint64_t to = rand() % 3 == 0 ? now + 1 + rand() % 5000 : next;
+        if (next == WHEEL_NEVER || to <= now)
+        {
+            correct = false;
+            break;
+        }
+
+        for (WheelTimer *timer = wheel_advance(wheel, to); timer != NULL; timer = timer->next)
+        {
+            int i = timer - timers;
+            if (cancelled[i] || timer->deadline > to || timer->deadline <= now || wheel_armed(timer))
+            {
+                correct = false;
+            }
+            fired++;
+        }
+        now = to;
+    }
+
+    correct = correct && wheel_next_expiry(wheel) == WHEEL_NEVER;
+    wheel_destroy(wheel);
+    return correct;
+}
+
+// Verify that a deadline in the past expires on the next advance and that
+// re-arming moves a timer.
+static bool verify_rearm(void)
+{
+    WheelTimer late;
+    WheelTimer moved;
+    bool correct = true;
+    Wheel *wheel = wheel_create(500);
+
+    wheel_timer_init(&late);
+    wheel_timer_init(&moved);
+    wheel_arm(wheel, &late, 100);
+    wheel_arm(wheel, &moved, 510);
+    wheel_arm(wheel, &moved, 9000);
+
+    if (wheel_next_expiry(wheel) != 500 || wheel_advance(wheel, 500) != &late || late.next != NULL)
+    {
+        correct = false;
+    }
+    if (wheel_advance(wheel, 8999) != NULL || !wheel_armed(&moved))
+    {
+        correct = false;
+    }
+    if (wheel_advance(wheel, 9000) != &moved || wheel_armed(&moved))
+    {
+        correct = false;
+    }
+
+    wheel_destroy(wheel);
+    return correct;
+}
+
+// Test program.
+int main(void)
+{
+    bool expiry_ok = verify_expiry();
+    printf("Test expiry on the first advance past the deadline ... %s\n", expiry_ok ? "PASS" : "FAIL");
+
+    bool rearm_ok = verify_rearm();
+    printf("Test late deadlines and re-arming ... %s\n", rearm_ok ? "PASS" : "FAIL");
+
+    return 0;
+}
@@ -0,0 +1,731 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "event.h"
+
+#define EPOLL_BATCH 64
+
+// What a completion belongs to, kept in the top byte of its user data
+#define URING_IGNORE 0  // Cancels, nothing to do
+#define URING_POLL 1    // Index is the descriptor
+#define URING_RECEIVE 2 // Index is the receiver slot
+#define URING_SEND 3    // Index is the send slot
+
+static bool setup_uring(EventLoop *loop);
+static uint32_t to_epoll(uint32_t flags);
+static uint32_t from_epoll(uint32_t events);
+static uint32_t from_poll(int32_t events);
+static int collect_timers(EventLoop *loop, Event *events, int count, int maxEvents);
+static int timer_timeout(const EventLoop *loop, int timeoutMs);
+static int uring_wait(EventLoop *loop, Event *events, int maxEvents, int timeoutMs);
+static uint64_t user_data(int kind, int index, uint32_t generation);
+static EventWatch *find_watch(EventLoop *loop, int fd);
+static void cancel_poll(EventLoop *loop, EventWatch *watch, int fd);
+static void arm_requests(EventLoop *loop);
+static void handle_completion(EventLoop *loop, const UringCompletion *completion);
+static void receive_done(EventLoop *loop, int slot, const UringCompletion *completion);
+static uint32_t ready_flags(EventLoop *loop, int fd);
+static EventReceiver *find_receiver(const EventLoop *loop, int fd);
+static void free_receiver(EventLoop *loop, int slot);
+
+//(The user has to free up memory.)
+EventLoop *event_loop_create(int backend)
+{
+    EventLoop *loop = calloc(1, sizeof(EventLoop));
+    if (loop == NULL)
+    {
+        return NULL;
+    }
+
+    loop->wheel = wheel_create(event_now_ms());
+    if (loop->wheel == NULL)
+    {
+        free(loop);
+        return NULL;
+    }
+
+    loop->backend = EVENT_BACKEND_EPOLL;
+    loop->epollFd = -1;
+    if (backend == EVENT_BACKEND_URING && setup_uring(loop))
+    {
+        loop->backend = EVENT_BACKEND_URING;
+        return loop;
+    }
+
+    loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epollFd == -1)
+    {
+        wheel_destroy(loop->wheel);
+        free(loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+//(FREEING UP MEMORY.)
+void event_loop_destroy(EventLoop *loop)
+{
+    if (loop->uring != NULL)
+    {
+        //Without their groups the receives still armed get no more buffers
+        for (int i = 0; i < EVENT_RECEIVERS; i++)
+        {
+            if (loop->receivers[i] != NULL)
+            {
+                free_receiver(loop, i);
+            }
+        }
+        uring_destroy(loop->uring);
+    }
+    if (loop->epollFd != -1)
+    {
+        close(loop->epollFd);
+    }
+    free(loop->watches);
+    free(loop->sends);
+    wheel_destroy(loop->wheel);
+    free(loop);
+}
+
+int event_loop_backend(const EventLoop *loop)
+{
+    return loop->backend;
+}
+
+bool event_loop_watch(EventLoop *loop, int fd, uint32_t flags, int tag)
+{
+    if (loop->uring != NULL)
+    {
+        EventWatch *watch = find_watch(loop, fd);
+        if (watch == NULL)
+        {
+            return false;
+        }
+
+        //The poll is armed again by the next wait if it waits for something else
+        watch->tag = tag;
+        watch->flags = flags;
+        watch->ready &= flags | EVENT_ERROR;
+        return true;
+    }
+
+    struct epoll_event event = {.events = to_epoll(flags), .data.u64 = (uint64_t)(uint32_t)tag};
+
+    if (epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, fd, &event) == 0)
+    {
+        return true;
+    }
+    if (errno != ENOENT)
+    {
+        return false;
+    }
+    return epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+void event_loop_unwatch(EventLoop *loop, int fd)
+{
+    if (loop->uring != NULL)
+    {
+        if (fd >= 0 && fd < loop->watchCount)
+        {
+            //A new descriptor with the number must not get the armed poll
+            cancel_poll(loop, &loop->watches[fd], fd);
+            loop->watches[fd].flags = 0;
+            loop->watches[fd].ready = 0;
+        }
+        return;
+    }
+
+    //Fails harmlessly if the descriptor was never watched
+    epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int event_loop_wait(EventLoop *loop, Event *events, int maxEvents, int timeoutMs)
+{
+    if (loop->uring != NULL)
+    {
+        return uring_wait(loop, events, maxEvents, timeoutMs);
+    }
+
+    struct epoll_event ready[EPOLL_BATCH];
+    int batch = maxEvents < EPOLL_BATCH ? maxEvents : EPOLL_BATCH;
+
+    int count = epoll_wait(loop->epollFd, ready, batch, timer_timeout(loop, timeoutMs));
+    if (count == -1)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        events[i].tag = (int)(uint32_t)ready[i].data.u64;
+        events[i].flags = from_epoll(ready[i].events);
+        events[i].timer = NULL;
+    }
+
+    return collect_timers(loop, events, count, maxEvents);
+}
+
+int event_loop_expired(EventLoop *loop, Event *events, int maxEvents)
+{
+    return collect_timers(loop, events, 0, maxEvents);
+}
+
+bool event_loop_receive(EventLoop *loop, int fd, size_t bufferSize, unsigned buffers)
+{
+    if (loop->uring == NULL || !loop->multishot)
+    {
+        return false;
+    }
+    if (find_receiver(loop, fd) != NULL)
+    {
+        return true;
+    }
+
+    int slot = 0;
+    while (slot < EVENT_RECEIVERS && loop->receivers[slot] != NULL)
+    {
+        slot++;
+    }
+    if (slot == EVENT_RECEIVERS)
+    {
+        return false;
+    }
+
+    EventReceiver *receiver = calloc(1, sizeof(EventReceiver));
+    if (receiver == NULL)
+    {
+        return false;
+    }
+    receiver->fd = fd;
+    receiver->count = buffers;
+    receiver->ids = malloc(buffers * sizeof(uint16_t));
+    receiver->lengths = malloc(buffers * sizeof(uint32_t));
+    receiver->buffers = uring_buffers_create(loop->uring, slot, buffers, bufferSize);
+    loop->receivers[slot] = receiver;
+    if (receiver->ids == NULL || receiver->lengths == NULL || receiver->buffers == NULL)
+    {
+        free_receiver(loop, slot);
+        return false;
+    }
+
+    //Armed by the next wait, with the polls
+    return true;
+}
+
+bool event_loop_receiving(const EventLoop *loop, int fd)
+{
+    return find_receiver(loop, fd) != NULL;
+}
+
+const void *event_loop_received(EventLoop *loop, int fd, size_t *size)
+{
+    EventReceiver *receiver = find_receiver(loop, fd);
+    if (receiver == NULL || receiver->queued == 0)
+    {
+        return NULL;
+    }
+
+    unsigned i = receiver->head & (receiver->count - 1);
+    *size = receiver->lengths[i] - receiver->offset;
+    return (unsigned char *)uring_buffer(receiver->buffers, receiver->ids[i]) + receiver->offset;
+}
+
+void event_loop_consume(EventLoop *loop, int fd, size_t size)
+{
+    EventReceiver *receiver = find_receiver(loop, fd);
+    unsigned i = receiver->head & (receiver->count - 1);
+
+    receiver->offset += size;
+    if (receiver->offset == receiver->lengths[i])
+    {
+        uring_buffer_recycle(receiver->buffers, receiver->ids[i]);
+        receiver->head++;
+        receiver->queued--;
+        receiver->offset = 0;
+    }
+}
+
+bool event_loop_receive_ended(EventLoop *loop, int fd, int *error)
+{
+    EventReceiver *receiver = find_receiver(loop, fd);
+    if (receiver == NULL || receiver->error == 0)
+    {
+        return false;
+    }
+
+    *error = receiver->error == -1 ? 0 : receiver->error;
+    return true;
+}
+
+void event_loop_receive_stop(EventLoop *loop, int fd)
+{
+    EventReceiver *receiver = find_receiver(loop, fd);
+    if (receiver == NULL)
+    {
+        return;
+    }
+
+    int slot = 0;
+    while (loop->receivers[slot] != receiver)
+    {
+        slot++;
+    }
+    if (!receiver->armed)
+    {
+        free_receiver(loop, slot);
+        return;
+    }
+
+    //Submitted at once, so the receive does not keep the socket open once
+    //the user closes it. The buffers are freed with its last completion
+    receiver->stopped = true;
+    uring_cancel(loop->uring, user_data(URING_RECEIVE, slot, 0), user_data(URING_IGNORE, 0, 0));
+    uring_enter(loop->uring, false, 0);
+}
+
+bool event_loop_send(EventLoop *loop, int fd, const void *message, size_t size, const struct sockaddr_in *addr)
+{
+    if (loop->uring == NULL || loop->freeCount == 0 || size > EVENT_SEND_SIZE)
+    {
+        return false;
+    }
+
+    int slot = loop->freeSends[--loop->freeCount];
+    EventSend *send = &loop->sends[slot];
+    memcpy(send->data, message, size);
+    send->addr = *addr;
+    send->iov.iov_base = send->data;
+    send->iov.iov_len = size;
+    memset(&send->header, 0, sizeof(send->header));
+    send->header.msg_name = &send->addr;
+    send->header.msg_namelen = sizeof(send->addr);
+    send->header.msg_iov = &send->iov;
+    send->header.msg_iovlen = 1;
+
+    if (!uring_sendmsg(loop->uring, fd, &send->header, user_data(URING_SEND, slot, 0)))
+    {
+        loop->freeSends[loop->freeCount++] = slot;
+        return false;
+    }
+    return true;
+}
+
+int event_loop_failed_sends(EventLoop *loop, int *error)
+{
+    int failed = loop->failedSends;
+    *error = loop->sendError;
+    loop->failedSends = 0;
+    return failed;
+}
+
+void event_timer_init(EventTimer *timer)
+{
+    wheel_timer_init(&timer->wheel);
+    timer->interval = 0;
+    timer->tag = 0;
+}
+
+void event_timer_start(EventLoop *loop, EventTimer *timer, int tag, int delayMs, int intervalMs)
+{
+    timer->interval = intervalMs;
+    timer->tag = tag;
+    wheel_arm(loop->wheel, &timer->wheel, event_now_ms() + delayMs);
+}
+
+void event_timer_stop(EventLoop *loop, EventTimer *timer)
+{
+    wheel_cancel(loop->wheel, &timer->wheel);
+}
+
+bool event_timer_active(const EventTimer *timer)
+{
+    return wheel_armed(&timer->wheel);
+}
+
+uint64_t event_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+uint64_t event_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static bool setup_uring(EventLoop *loop)
+{
+    loop->uring = uring_create(EVENT_URING_ENTRIES, EVENT_URING_COMPLETIONS);
+    loop->sends = malloc(EVENT_SENDS * sizeof(EventSend));
+    if (loop->uring == NULL || loop->sends == NULL)
+    {
+        if (loop->uring != NULL)
+        {
+            uring_destroy(loop->uring);
+            loop->uring = NULL;
+        }
+        free(loop->sends);
+        loop->sends = NULL;
+        return false;
+    }
+
+    for (int i = 0; i < EVENT_SENDS; i++)
+    {
+        loop->freeSends[i] = i;
+    }
+    loop->freeCount = EVENT_SENDS;
+    loop->multishot = true;
+    return true;
+}
+
+static uint32_t to_epoll(uint32_t flags)
+{
+    uint32_t events = 0;
+    if (flags & EVENT_READ)
+    {
+        events |= EPOLLIN;
+    }
+    if (flags & EVENT_WRITE)
+    {
+        events |= EPOLLOUT;
+    }
+    return events;
+}
+
+static uint32_t from_epoll(uint32_t events)
+{
+    uint32_t flags = 0;
+    if (events & EPOLLIN)
+    {
+        flags |= EVENT_READ;
+    }
+    if (events & EPOLLOUT)
+    {
+        flags |= EVENT_WRITE;
+    }
+    if (events & (EPOLLHUP | EPOLLERR))
+    {
+        flags |= EVENT_ERROR;
+    }
+    return flags;
+}
+
+static uint32_t from_poll(int32_t events)
+{
+    uint32_t flags = 0;
+    if (events & POLLIN)
+    {
+        flags |= EVENT_READ;
+    }
+    if (events & POLLOUT)
+    {
+        flags |= EVENT_WRITE;
+    }
+    if (events & (POLLHUP | POLLERR))
+    {
+        flags |= EVENT_ERROR;
+    }
+    return flags;
+}
+
+// Append the expired timers after the "count" ready descriptors and move
+// their deadlines on. Timers that do not fit expire on the next wait.
+static int collect_timers(EventLoop *loop, Event *events, int count, int maxEvents)
+{
+    uint64_t now = event_now_ms();
+    WheelTimer *expired = wheel_advance(loop->wheel, now);
+
+    while (expired != NULL)
+    {
+        WheelTimer *next = expired->next;
+        EventTimer *timer = (EventTimer *)expired;
+
+        if (count == maxEvents)
+        {
+            wheel_arm(loop->wheel, expired, now);
+        }
+        else
+        {
+            events[count].tag = timer->tag;
+            events[count].flags = EVENT_TIMER;
+            events[count].timer = timer;
+            count++;
+
+            if (timer->interval > 0)
+            {
+                //Skip expiries that were missed instead of firing them in a burst
+                uint64_t deadline = expired->deadline;
+                while (deadline <= now)
+                {
+                    deadline += timer->interval;
+                }
+                wheel_arm(loop->wheel, expired, deadline);
+            }
+        }
+        expired = next;
+    }
+
+    return count;
+}
+
+// The wait ends at the latest when the first timer expires
+static int timer_timeout(const EventLoop *loop, int timeoutMs)
+{
+    uint64_t next = wheel_next_expiry(loop->wheel);
+    if (next == WHEEL_NEVER)
+    {
+        return timeoutMs;
+    }
+
+    uint64_t now = event_now_ms();
+    int untilDeadline = next <= now ? 0 : (int)(next - now);
+    if (timeoutMs < 0 || untilDeadline < timeoutMs)
+    {
+        timeoutMs = untilDeadline;
+    }
+
+    return timeoutMs;
+}
+
+// Arm what the last wait left unarmed, then submit it and wait with one
+// system call. Nothing is waited for when something is ready already
+static int uring_wait(EventLoop *loop, Event *events, int maxEvents, int timeoutMs)
+{
+    arm_requests(loop);
+
+    bool ready = false;
+    for (int fd = 0; fd < loop->watchCount && !ready; fd++)
+    {
+        ready = ready_flags(loop, fd) != 0;
+    }
+    if (!uring_enter(loop->uring, !ready, ready ? 0 : timer_timeout(loop, timeoutMs)))
+    {
+        return -1;
+    }
+
+    UringCompletion completion;
+    while (uring_next(loop->uring, &completion))
+    {
+        handle_completion(loop, &completion);
+    }
+
+    int count = 0;
+    for (int fd = 0; fd < loop->watchCount && count < maxEvents; fd++)
+    {
+        uint32_t flags = ready_flags(loop, fd);
+        if (flags != 0)
+        {
+            events[count].tag = loop->watches[fd].tag;
+            events[count].flags = flags;
+            events[count].timer = NULL;
+            count++;
+            loop->watches[fd].ready = 0;
+        }
+    }
+
+    return collect_timers(loop, events, count, maxEvents);
+}
+
+// A completion carries its kind, index and generation in its user data
+static uint64_t user_data(int kind, int index, uint32_t generation)
+{
+    return (uint64_t)kind << 56 | (uint64_t)generation << 24 | (uint32_t)index;
+}
+
+// The watch of a descriptor, growing the table to hold it
+static EventWatch *find_watch(EventLoop *loop, int fd)
+{
+    if (fd < 0)
+    {
+        errno = EBADF;
+        return NULL;
+    }
+    if (fd >= loop->watchCount)
+    {
+        int count = fd + 1 > 2 * loop->watchCount ? fd + 1 : 2 * loop->watchCount;
+        EventWatch *watches = realloc(loop->watches, count * sizeof(EventWatch));
+        if (watches == NULL)
+        {
+            return NULL;
+        }
+        memset(&watches[loop->watchCount], 0, (count - loop->watchCount) * sizeof(EventWatch));
+        loop->watches = watches;
+        loop->watchCount = count;
+    }
+
+    return &loop->watches[fd];
+}
+
+// Cancel the armed poll of a watch, a completion it still has is ignored
+static void cancel_poll(EventLoop *loop, EventWatch *watch, int fd)
+{
+    if (watch->polling)
+    {
+        uring_cancel(loop->uring, user_data(URING_POLL, fd, watch->generation), user_data(URING_IGNORE, 0, 0));
+        watch->polling = false;
+    }
+    watch->generation++;
+}
+
+// Arm a poll for every watch that waits for something no receive reports,
+// and a receive for every receiver with a free buffer
+static void arm_requests(EventLoop *loop)
+{
+    for (int fd = 0; fd < loop->watchCount; fd++)
+    {
+        EventWatch *watch = &loop->watches[fd];
+        uint32_t flags = find_receiver(loop, fd) != NULL ? watch->flags & ~EVENT_READ : watch->flags;
+        uint32_t events = (flags & EVENT_READ ? POLLIN : 0) | (flags & EVENT_WRITE ? POLLOUT : 0);
+
+        if (watch->polling && watch->polled != events)
+        {
+            cancel_poll(loop, watch, fd);
+        }
+        if (!watch->polling && events != 0 && uring_poll(loop->uring, fd, events, user_data(URING_POLL, fd, watch->generation)))
+        {
+            watch->polling = true;
+            watch->polled = events;
+        }
+    }
+
+    for (int slot = 0; slot < EVENT_RECEIVERS; slot++)
+    {
+        EventReceiver *receiver = loop->receivers[slot];
+        if (receiver != NULL && !receiver->armed && !receiver->stopped && receiver->error == 0 &&
+            receiver->queued < receiver->count)
+        {
+            receiver->armed = uring_receive(loop->uring, receiver->fd, receiver->buffers, user_data(URING_RECEIVE, slot, 0));
+        }
+    }
+}
+
+static void handle_completion(EventLoop *loop, const UringCompletion *completion)
+{
+    int kind = (int)(completion->userData >> 56);
+    int index = (int)(completion->userData & 0xffffff);
+    uint32_t generation = (uint32_t)(completion->userData >> 24);
+
+    if (kind == URING_POLL && index < loop->watchCount)
+    {
+        EventWatch *watch = &loop->watches[index];
+        if (watch->polling && watch->generation == generation)
+        {
+            watch->polling = false;
+            watch->ready |= completion->result < 0 ? EVENT_ERROR : from_poll(completion->result);
+        }
+    }
+    else if (kind == URING_RECEIVE)
+    {
+        receive_done(loop, index, completion);
+    }
+    else if (kind == URING_SEND)
+    {
+        loop->freeSends[loop->freeCount++] = index;
+        if (completion->result < 0)
+        {
+            loop->failedSends++;
+            loop->sendError = -completion->result;
+        }
+    }
+}
+
+// Queue what a receive completed with, and see why it ended if it did
+static void receive_done(EventLoop *loop, int slot, const UringCompletion *completion)
+{
+    EventReceiver *receiver = loop->receivers[slot];
+
+    if (completion->buffer >= 0)
+    {
+        if (receiver->stopped || completion->result <= 0)
+        {
+            uring_buffer_recycle(receiver->buffers, completion->buffer);
+        }
+        else
+        {
+            unsigned i = (receiver->head + receiver->queued) & (receiver->count - 1);
+            receiver->ids[i] = completion->buffer;
+            receiver->lengths[i] = completion->result;
+            receiver->queued++;
+        }
+    }
+    if (completion->more)
+    {
+        return;
+    }
+
+    receiver->armed = false;
+    if (receiver->stopped)
+    {
+        free_receiver(loop, slot);
+    }
+    else if (completion->result == -EINVAL)
+    {
+        //The kernel has no multishot receives, the user reads the socket
+        loop->multishot = false;
+        free_receiver(loop, slot);
+    }
+    else if (completion->result == 0 && completion->buffer < 0)
+    {
+        receiver->error = -1;
+    }
+    else if (completion->result < 0 && completion->result != -ENOBUFS)
+    {
+        receiver->error = -completion->result;
+    }
+    //Otherwise the next wait arms it again, once a buffer is free
+}
+
+// What a wait reports for a descriptor. A receiving socket is readable while
+// it holds data or has ended, like a socket the user reads
+static uint32_t ready_flags(EventLoop *loop, int fd)
+{
+    EventWatch *watch = &loop->watches[fd];
+    uint32_t flags = watch->ready & (watch->flags | EVENT_ERROR);
+
+    if (watch->flags & EVENT_READ)
+    {
+        EventReceiver *receiver = find_receiver(loop, fd);
+        if (receiver != NULL && (receiver->queued > 0 || receiver->error != 0))
+        {
+            flags |= EVENT_READ;
+        }
+    }
+    return flags;
+}
+
+static EventReceiver *find_receiver(const EventLoop *loop, int fd)
+{
+    for (int slot = 0; slot < EVENT_RECEIVERS; slot++)
+    {
+        EventReceiver *receiver = loop->receivers[slot];
+        if (receiver != NULL && receiver->fd == fd && !receiver->stopped)
+        {
+            return receiver;
+        }
+    }
+    return NULL;
+}
+
+// Free a receiver that is not armed, or whose receive may no longer get
+// buffers
+static void free_receiver(EventLoop *loop, int slot)
+{
+    EventReceiver *receiver = loop->receivers[slot];
+    if (receiver->buffers != NULL)
+    {
+        uring_buffers_destroy(loop->uring, receiver->buffers);
+    }
+    free(receiver->ids);
+    free(receiver->lengths);
+    free(receiver);
+    loop->receivers[slot] = NULL;
+}
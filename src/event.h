@@ -0,0 +1,379 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "datatypes/wheel.h"
+#include "uring.h"
+
+#define EVENT_READ 0x1  // The descriptor can be read
+#define EVENT_WRITE 0x2 // The descriptor can be written
+#define EVENT_ERROR 0x4 // Hang up or error on the descriptor
+#define EVENT_TIMER 0x8 // A timer expired
+
+#define EVENT_BACKEND_EPOLL 0 // Readiness from epoll
+#define EVENT_BACKEND_URING 1 // Readiness, receives and sends through io_uring
+
+#define EVENT_URING_ENTRIES 256 // Requests queued between two waits before they are submitted
+#define EVENT_URING_COMPLETIONS 4096
+#define EVENT_RECEIVERS 16 // Descriptors with a multishot receive at a time
+#define EVENT_SENDS 256 // Datagrams sent through io_uring and not completed
+#define EVENT_SEND_SIZE 2048 // Largest datagram sent through io_uring
+
+/**
+ * @defgroup event event.h
+ * @brief The header file for the functions used in the event loop.
+ * The loop watches any number of descriptors with epoll and reports which
+ * of them are ready to be read or written, together with expired timers.
+ * Every descriptor and timer carries a tag chosen by the user, so a ready
+ * event can be dispatched without searching for its owner. Timers are kept
+ * in a timer wheel and owned by the user, so any number of them can be
+ * started and stopped in constant time.
+ *
+ * With the io_uring backend readiness comes from one shot polls that are
+ * armed again by every wait, so it stays level triggered. On top of that
+ * a descriptor can receive through a multishot receive, the loop then
+ * holds what arrived until the user reads it, and datagrams can be sent
+ * without a system call of their own. Everything queued is submitted by
+ * the next wait, with the same system call that waits.
+ *
+ * @{
+ */
+
+/**
+ * @brief A timer, expiring after a delay and then every "interval" ms.
+ *
+ * A timer with an interval of 0 expires once. The timer is embedded in
+ * whatever it is the timer of and has to stay where it is while started.
+ */
+typedef struct event_timer
+{
+    WheelTimer wheel;
+    int interval;
+    int tag;
+} EventTimer;
+
+/**
+ * @brief A ready descriptor or an expired timer.
+ *
+ * "flags" holds EVENT_READ, EVENT_WRITE and EVENT_ERROR for a descriptor,
+ * or only EVENT_TIMER for a timer. "timer" is the expired timer, or NULL
+ * for a descriptor.
+ */
+typedef struct event
+{
+    int tag;
+    uint32_t flags;
+    EventTimer *timer;
+} Event;
+
+/**
+ * @brief A descriptor watched through io_uring.
+ *
+ * "ready" collects what completed polls reported until a wait returns it.
+ * "generation" tells the completion of the armed poll from those of polls
+ * that were cancelled, "polled" is what the armed poll waits for.
+ */
+typedef struct event_watch
+{
+    int tag;
+    uint32_t flags;
+    uint32_t ready;
+    uint32_t polled;
+    uint32_t generation;
+    bool polling;
+} EventWatch;
+
+/**
+ * @brief A descriptor receiving through a multishot receive.
+ *
+ * Buffers that were received into wait in "ids" and "lengths", from
+ * "head" on, until the user has read them. "offset" bytes of the oldest
+ * are read. "error" is set once nothing more arrives, -1 if the peer
+ * closed the stream. A stopped receiver is freed with its last completion.
+ */
+typedef struct event_receiver
+{
+    int fd;
+    UringBuffers *buffers;
+    uint16_t *ids;
+    uint32_t *lengths;
+    unsigned count;
+    unsigned head;
+    unsigned queued;
+    size_t offset;
+    int error;
+    bool armed;
+    bool stopped;
+} EventReceiver;
+
+/**
+ * @brief A datagram being sent through io_uring, the kernel reads it
+ * until the send completes.
+ */
+typedef struct event_send
+{
+    struct msghdr header;
+    struct iovec iov;
+    struct sockaddr_in addr;
+    unsigned char data[EVENT_SEND_SIZE];
+} EventSend;
+
+/**
+ * @brief The structure for an "event loop".
+ *
+ * Only the fields of its backend are used. The receiver in slot i
+ * receives into buffer group i.
+ */
+typedef struct event_loop
+{
+    int backend;
+    int epollFd;
+    Wheel *wheel;
+    Uring *uring;
+    EventWatch *watches; // Indexed by descriptor
+    int watchCount;
+    EventReceiver *receivers[EVENT_RECEIVERS];
+    bool multishot; // False once the kernel refused a multishot receive
+    EventSend *sends;
+    int freeSends[EVENT_SENDS];
+    int freeCount;
+    int failedSends; // Sends that failed since the user last asked
+    int sendError;
+} EventLoop;
+
+/**
+ * @brief Creates an event loop without descriptors or timers.
+ *
+ * A loop asked for io_uring uses epoll if the kernel lacks what it needs,
+ * "event_loop_backend" tells which one it got.
+ * <b>OBS</b>: The user has to free up memory with "event_loop_destroy".
+ * @param int EVENT_BACKEND_EPOLL or EVENT_BACKEND_URING.
+ * @return *EventLoop A pointer to the loop, or NULL with errno set.
+ */
+EventLoop *event_loop_create(int backend);
+
+/**
+ * @brief Returns the backend a loop uses.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @return int EVENT_BACKEND_EPOLL or EVENT_BACKEND_URING.
+ */
+int event_loop_backend(const EventLoop *loop);
+
+/**
+ * @brief Deallocate the event loop. Watched descriptors are not closed and
+ * started timers are forgotten.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ * @param EventLoop* Pointer to a loop.
+ * @return Void
+ */
+void event_loop_destroy(EventLoop *loop);
+
+/**
+ * @brief Watches a descriptor, or changes what an already watched
+ * descriptor is watched for.
+ *
+ * Readiness is level triggered, a descriptor is reported by every wait
+ * for as long as it stays ready.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @param int The descriptor.
+ * @param uint32_t EVENT_READ and/or EVENT_WRITE.
+ * @param int The tag reported with the descriptor.
+ * @return Bool False, with errno set, if the descriptor was refused.
+ */
+bool event_loop_watch(EventLoop *loop, int fd, uint32_t flags, int tag);
+
+/**
+ * @brief Stops watching a descriptor.
+ *
+ * Call it before the descriptor is closed, its number may be reused.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @param int The descriptor.
+ * @return Void
+ */
+void event_loop_unwatch(EventLoop *loop, int fd);
+
+/**
+ * @brief Waits until a watched descriptor is ready or a timer expires.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @param Event* Filled with the ready descriptors, then the expired timers.
+ * @param int Size of the events array.
+ * @param int Longest wait in ms when no timer expires first, -1 for no limit.
+ * @return int Number of events, 0 on timeout or -1 with errno set.
+ */
+int event_loop_wait(EventLoop *loop, Event *events, int maxEvents, int timeoutMs);
+
+/**
+ * @brief Starts receiving on a socket through a multishot receive, with
+ * the io_uring backend.
+ *
+ * The socket is then reported readable while what it received waits to be
+ * read with "event_loop_received", or once nothing more will arrive, and
+ * it keeps receiving into its buffers while it is not watched.
+ * Nothing happens if it already receives.
+ * @param EventLoop* Pointer to a loop.
+ * @param int The socket, connected if it is a stream.
+ * @param size_t The size of a buffer, the largest datagram that fits.
+ * @param unsigned The number of buffers, a power of two.
+ * @return Bool False if the socket has to be read by the user.
+ */
+bool event_loop_receive(EventLoop *loop, int fd, size_t bufferSize, unsigned buffers);
+
+/**
+ * @brief Checks if a socket receives through the loop.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @param int The socket.
+ * @return Bool True if "event_loop_received" has to be used to read it.
+ */
+bool event_loop_receiving(const EventLoop *loop, int fd);
+
+/**
+ * @brief Returns the oldest datagram, or part of a stream, that a socket
+ * received and that was not read yet.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @param int The socket.
+ * @param size_t* Set to the size of what is returned.
+ * @return Void* The data, valid until "event_loop_consume", or NULL.
+ */
+const void *event_loop_received(EventLoop *loop, int fd, size_t *size);
+
+/**
+ * @brief Marks bytes returned by "event_loop_received" as read. The buffer
+ * goes back to the kernel once all of it is read.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @param int The socket.
+ * @param size_t Bytes read, at most what was returned.
+ * @return Void
+ */
+void event_loop_consume(EventLoop *loop, int fd, size_t size);
+
+/**
+ * @brief Checks if a socket will receive nothing more.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @param int The socket.
+ * @param int* Set to 0 if the peer closed the stream, or to the errno the
+ * receive failed with.
+ * @return Bool True if the receive ended.
+ */
+bool event_loop_receive_ended(EventLoop *loop, int fd, int *error);
+
+/**
+ * @brief Stops receiving on a socket, what was not read is dropped.
+ *
+ * Call it before the socket is closed. Nothing happens if the socket does
+ * not receive through the loop.
+ * @param EventLoop* Pointer to a loop.
+ * @param int The socket.
+ * @return Void
+ */
+void event_loop_receive_stop(EventLoop *loop, int fd);
+
+/**
+ * @brief Queues a copy of a datagram to be sent by the next wait, with the
+ * io_uring backend.
+ *
+ * A datagram the socket buffer has no room for waits for room instead of
+ * being dropped.
+ * @param EventLoop* Pointer to a loop.
+ * @param int The socket.
+ * @param Void* The datagram.
+ * @param size_t The size of the datagram.
+ * @param sockaddr_in* Where to send it.
+ * @return Bool False if it was not queued and has to be sent by the user.
+ */
+bool event_loop_send(EventLoop *loop, int fd, const void *message, size_t size, const struct sockaddr_in *addr);
+
+/**
+ * @brief Returns the number of queued sends that failed since the last
+ * call.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @param int* Set to the errno of the last failure.
+ * @return int Failed sends.
+ */
+int event_loop_failed_sends(EventLoop *loop, int *error);
+
+/**
+ * @brief Collects the expired timers without waiting for descriptors.
+ *
+ * Lets a busy user that does not call "event_loop_wait" between messages
+ * still serve its timers.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @param Event* Filled with the expired timers.
+ * @param int Size of the events array.
+ * @return int Number of expired timers.
+ */
+int event_loop_expired(EventLoop *loop, Event *events, int maxEvents);
+
+/**
+ * @brief Prepares a timer for use, it is not started.
+ *
+ * @param EventTimer* Pointer to a timer.
+ * @return Void
+ */
+void event_timer_init(EventTimer *timer);
+
+/**
+ * @brief Starts a timer, or restarts it if it is already started.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @param EventTimer* Pointer to a timer.
+ * @param int The tag reported when the timer expires.
+ * @param int Delay in ms until the timer first expires.
+ * @param int Interval in ms between later expiries, 0 to expire once.
+ * @return Void
+ */
+void event_timer_start(EventLoop *loop, EventTimer *timer, int tag, int delayMs, int intervalMs);
+
+/**
+ * @brief Stops a timer, nothing happens if it is not started.
+ *
+ * @param EventLoop* Pointer to a loop.
+ * @param EventTimer* Pointer to a timer.
+ * @return Void
+ */
+void event_timer_stop(EventLoop *loop, EventTimer *timer);
+
+/**
+ * @brief Returns true if the timer is started and has not expired for the
+ * last time.
+ *
+ * @param EventTimer* Pointer to a timer.
+ * @return Bool True if the timer is started.
+ */
+bool event_timer_active(const EventTimer *timer);
+
+/**
+ * @brief Returns a monotonic time in ms.
+ *
+ * @param Void
+ * @return uint64_t Milliseconds since an arbitrary point.
+ */
+uint64_t event_now_ms(void);
+
+/**
+ * @brief Returns a monotonic time in ns, for measuring short intervals.
+ *
+ * @param Void
+ * @return uint64_t Nanoseconds since an arbitrary point.
+ */
+uint64_t event_now_ns(void);
+
+/**
+ * @}
+ */
+
+#endif /* EVENT_H */
@@ -0,0 +1,554 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "log.h"
+
+#define LOG_LINE 1024 // Longest formatted line, longer ones are cut
+#define LOG_SPEC 32   // Longest conversion specification
+#define LOG_STRING_CUT 0x8000 // Set in the stored length of a string that was cut
+
+enum log_arg
+{
+    ARG_NONE,    // "%%", takes no argument
+    ARG_INT,     // int, or shorter and promoted to int
+    ARG_WIDE,    // long, long long, size_t, intmax_t or ptrdiff_t
+    ARG_DOUBLE,
+    ARG_STRING,
+    ARG_POINTER,
+    ARG_BAD      // Not supported, written as it is
+};
+
+struct log_record
+{
+    const char *format;
+    uint8_t level;
+    bool cut; // Arguments did not fit, the rest of the format is written as it is
+    uint16_t size;
+    unsigned char args[LOG_ARGS_SIZE];
+};
+
+typedef struct log_ring
+{
+    struct log_record records[LOG_RECORDS];
+    _Alignas(64) atomic_size_t head; // Written by the log thread only
+    _Alignas(64) atomic_size_t tail; // Written by the producer only
+    atomic_uint_fast64_t dropped;
+    uint64_t reported; // Drops the log thread has reported
+} LogRing;
+
+static LogRing *_Atomic rings[LOG_PRODUCERS];
+static atomic_int ringCount;
+static _Thread_local LogRing *current;
+static pthread_t thread;
+static atomic_bool running;
+static atomic_bool stopping;
+static atomic_bool sleeping; // The log thread waits on wakeFd
+static int wakeFd = -1;
+
+static void *log_main(void *arg);
+static bool drain(void);
+static bool rings_empty(void);
+static void wake(void);
+static size_t format_record(const struct log_record *record, char *line);
+static size_t parse_spec(const char *spec, enum log_arg *arg);
+static size_t pack_args(unsigned char *args, const char *format, va_list list, bool *cut);
+static FILE *stream_of(int level);
+
+bool log_start(void)
+{
+    static bool registered = false;
+
+    if (atomic_load(&running))
+    {
+        return true;
+    }
+    if (current == NULL && !log_attach())
+    {
+        return false;
+    }
+
+    if (wakeFd == -1)
+    {
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        if (wakeFd == -1)
+        {
+            return false;
+        }
+    }
+
+    //Signals are for the threads of the program, not for the log thread
+    sigset_t all;
+    sigset_t old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    atomic_store(&stopping, false);
+    int error = pthread_create(&thread, NULL, log_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (error != 0)
+    {
+        return false;
+    }
+
+    atomic_store(&running, true);
+    if (!registered)
+    {
+        registered = true;
+        atexit(log_stop);
+    }
+
+    return true;
+}
+
+bool log_attach(void)
+{
+    int index = atomic_fetch_add(&ringCount, 1);
+    if (index >= LOG_PRODUCERS)
+    {
+        atomic_fetch_sub(&ringCount, 1);
+        return false;
+    }
+
+    LogRing *ring = calloc(1, sizeof(LogRing));
+    if (ring == NULL)
+    {
+        return false;
+    }
+
+    atomic_store_explicit(&rings[index], ring, memory_order_release);
+    current = ring;
+    return true;
+}
+
+void log_stop(void)
+{
+    if (!atomic_exchange(&running, false))
+    {
+        return;
+    }
+
+    atomic_store(&stopping, true);
+    wake();
+    pthread_join(thread, NULL);
+}
+
+void log_write(int level, const char *format, ...)
+{
+    va_list list;
+    LogRing *ring = current;
+
+    if (ring == NULL || !atomic_load_explicit(&running, memory_order_relaxed))
+    {
+        va_start(list, format);
+        vfprintf(stream_of(level), format, list);
+        va_end(list);
+        return;
+    }
+
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - head == LOG_RECORDS)
+    {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    struct log_record *record = &ring->records[tail & (LOG_RECORDS - 1)];
+    record->format = format;
+    record->level = level;
+    va_start(list, format);
+    record->size = pack_args(record->args, format, list, &record->cut);
+    va_end(list);
+
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    //Pairs with the fence in log_main, either the log thread sees the
+    //record before it sleeps or we see it sleeping
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&sleeping, memory_order_relaxed))
+    {
+        wake();
+    }
+}
+
+uint64_t log_dropped(void)
+{
+    uint64_t dropped = 0;
+    int count = atomic_load(&ringCount);
+
+    for (int i = 0; i < count && i < LOG_PRODUCERS; i++)
+    {
+        LogRing *ring = atomic_load_explicit(&rings[i], memory_order_acquire);
+        if (ring != NULL)
+        {
+            dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        }
+    }
+
+    return dropped;
+}
+
+static void *log_main(void *arg)
+{
+    (void)arg;
+
+    while (!atomic_load(&stopping))
+    {
+        if (drain())
+        {
+            continue;
+        }
+
+        atomic_store_explicit(&sleeping, true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (rings_empty() && !atomic_load(&stopping))
+        {
+            uint64_t count;
+            while (read(wakeFd, &count, sizeof(count)) == -1 && errno == EINTR)
+            {
+            }
+        }
+        atomic_store_explicit(&sleeping, false, memory_order_relaxed);
+    }
+
+    //Records logged before log_stop was called
+    drain();
+    return NULL;
+}
+
+// Write the records of every ring, true if there were any
+static bool drain(void)
+{
+    char line[LOG_LINE];
+    bool written = false;
+    int count = atomic_load(&ringCount);
+
+    for (int i = 0; i < count && i < LOG_PRODUCERS; i++)
+    {
+        LogRing *ring = atomic_load_explicit(&rings[i], memory_order_acquire);
+        if (ring == NULL)
+        {
+            continue;
+        }
+
+        size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        for (; head != tail; head++)
+        {
+            const struct log_record *record = &ring->records[head & (LOG_RECORDS - 1)];
+            size_t length = format_record(record, line);
+            fwrite(line, 1, length, stream_of(record->level));
+            written = true;
+        }
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+
+        uint64_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        if (dropped != ring->reported)
+        {
+            fprintf(stderr, "Log ring full, dropped %llu records\n", (unsigned long long)(dropped - ring->reported));
+            ring->reported = dropped;
+        }
+    }
+
+    if (written)
+    {
+        fflush(stdout);
+        fflush(stderr);
+    }
+    return written;
+}
+
+// True if no ring holds a record
+static bool rings_empty(void)
+{
+    int count = atomic_load(&ringCount);
+
+    for (int i = 0; i < count && i < LOG_PRODUCERS; i++)
+    {
+        LogRing *ring = atomic_load_explicit(&rings[i], memory_order_acquire);
+        if (ring != NULL && atomic_load_explicit(&ring->head, memory_order_relaxed) != atomic_load_explicit(&ring->tail, memory_order_acquire))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void wake(void)
+{
+    uint64_t one = 1;
+    while (write(wakeFd, &one, sizeof(one)) == -1 && errno == EINTR)
+    {
+    }
+}
+
+// Format a record like printf would have, returns the length of the line
+static size_t format_record(const struct log_record *record, char *line)
+{
+    const char *format = record->format;
+    const unsigned char *args = record->args;
+    const unsigned char *end = record->args + record->size;
+    size_t length = 0;
+
+    while (*format != '\0' && length < LOG_LINE - 1)
+    {
+        if (*format != '%')
+        {
+            line[length++] = *format++;
+            continue;
+        }
+
+        enum log_arg arg;
+        size_t specLength = 1 + parse_spec(format + 1, &arg);
+        char spec[LOG_SPEC];
+        if (specLength >= LOG_SPEC || arg == ARG_BAD || (arg != ARG_NONE && args >= end))
+        {
+            //Written as it is
+            size_t n = specLength < LOG_LINE - 1 - length ? specLength : LOG_LINE - 1 - length;
+            memcpy(&line[length], format, n);
+            length += n;
+            format += specLength;
+            continue;
+        }
+
+        //Wide integers are passed as long long, whatever their length modifier
+        size_t n = 0;
+        for (size_t i = 0; i < specLength - 1; i++)
+        {
+            if (arg != ARG_WIDE || strchr("hlzjt", format[i]) == NULL)
+            {
+                spec[n++] = format[i];
+            }
+        }
+        if (arg == ARG_WIDE)
+        {
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+        }
+        spec[n++] = format[specLength - 1];
+        spec[n] = '\0';
+        format += specLength;
+
+        size_t room = LOG_LINE - length;
+        int written = 0;
+        if (arg == ARG_NONE)
+        {
+            written = snprintf(&line[length], room, "%%");
+        }
+        else if (arg == ARG_INT)
+        {
+            int value;
+            memcpy(&value, args, sizeof(value));
+            args += sizeof(value);
+            written = snprintf(&line[length], room, spec, value);
+        }
+        else if (arg == ARG_WIDE)
+        {
+            long long value;
+            memcpy(&value, args, sizeof(value));
+            args += sizeof(value);
+            written = snprintf(&line[length], room, spec, value);
+        }
+        else if (arg == ARG_DOUBLE)
+        {
+            double value;
+            memcpy(&value, args, sizeof(value));
+            args += sizeof(value);
+            written = snprintf(&line[length], room, spec, value);
+        }
+        else if (arg == ARG_POINTER)
+        {
+            void *value;
+            memcpy(&value, args, sizeof(value));
+            args += sizeof(value);
+            written = snprintf(&line[length], room, spec, value);
+        }
+        else
+        {
+            uint16_t stringLength;
+            memcpy(&stringLength, args, sizeof(stringLength));
+            bool stringCut = stringLength & LOG_STRING_CUT;
+            stringLength &= ~LOG_STRING_CUT;
+            char value[LOG_STRING_MAX + sizeof("...")];
+            memcpy(value, args + sizeof(stringLength), stringLength);
+            strcpy(&value[stringLength], stringCut ? "..." : "");
+            args += sizeof(stringLength) + stringLength;
+            written = snprintf(&line[length], room, spec, value);
+        }
+
+        if (written > 0)
+        {
+            length += (size_t)written < room ? (size_t)written : room - 1;
+        }
+    }
+
+    //A line that was cut still ends the line
+    if ((record->cut || length == LOG_LINE - 1) && length > 0 && line[length - 1] != '\n')
+    {
+        line[length < LOG_LINE - 1 ? length++ : length - 1] = '\n';
+    }
+    return length;
+}
+
+// Parse the conversion after a '%' and return its length. "*" widths and
+// precisions and long doubles are not supported
+static size_t parse_spec(const char *spec, enum log_arg *arg)
+{
+    size_t i = 0;
+    bool wide = false;
+
+    while (spec[i] != '\0' && strchr("-+ #0", spec[i]) != NULL)
+    {
+        i++;
+    }
+    while (spec[i] >= '0' && spec[i] <= '9')
+    {
+        i++;
+    }
+    if (spec[i] == '.')
+    {
+        i++;
+        while (spec[i] >= '0' && spec[i] <= '9')
+        {
+            i++;
+        }
+    }
+    while (spec[i] != '\0' && strchr("hlzjt", spec[i]) != NULL)
+    {
+        wide = wide || spec[i] != 'h';
+        i++;
+    }
+
+    switch (spec[i])
+    {
+    case '\0':
+        *arg = ARG_BAD;
+        return i;
+    case '%':
+        *arg = i == 0 ? ARG_NONE : ARG_BAD;
+        break;
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'c':
+        *arg = wide ? ARG_WIDE : ARG_INT;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        *arg = wide ? ARG_BAD : ARG_DOUBLE;
+        break;
+    case 's':
+        *arg = wide ? ARG_BAD : ARG_STRING;
+        break;
+    case 'p':
+        *arg = ARG_POINTER;
+        break;
+    default:
+        *arg = ARG_BAD;
+        break;
+    }
+
+    return i + 1;
+}
+
+// Copy the arguments of the format into the record, returns their size.
+// "cut" is set if they did not all fit
+static size_t pack_args(unsigned char *args, const char *format, va_list list, bool *cut)
+{
+    size_t size = 0;
+    *cut = false;
+
+    while ((format = strchr(format, '%')) != NULL)
+    {
+        enum log_arg arg;
+        format += 1 + parse_spec(format + 1, &arg);
+
+        if (arg == ARG_NONE)
+        {
+            continue;
+        }
+        if (arg == ARG_BAD)
+        {
+            //The arguments after it can not be found any more
+            break;
+        }
+
+        if (arg == ARG_STRING)
+        {
+            const char *value = va_arg(list, const char *);
+            if (value == NULL)
+            {
+                value = "(null)";
+            }
+            size_t length = strnlen(value, LOG_STRING_MAX + 1);
+            uint16_t stringLength = length;
+            if (length > LOG_STRING_MAX)
+            {
+                length = LOG_STRING_MAX;
+                stringLength = length | LOG_STRING_CUT;
+            }
+            if (size + sizeof(uint16_t) + length > LOG_ARGS_SIZE)
+            {
+                *cut = true;
+                break;
+            }
+            memcpy(&args[size], &stringLength, sizeof(stringLength));
+            memcpy(&args[size + sizeof(stringLength)], value, length);
+            size += sizeof(stringLength) + length;
+            continue;
+        }
+
+        if (size + 8 > LOG_ARGS_SIZE)
+        {
+            *cut = true;
+            break;
+        }
+        if (arg == ARG_INT)
+        {
+            int value = va_arg(list, int);
+            memcpy(&args[size], &value, sizeof(value));
+            size += sizeof(value);
+        }
+        else if (arg == ARG_WIDE)
+        {
+            long long value = va_arg(list, long long);
+            memcpy(&args[size], &value, sizeof(value));
+            size += sizeof(value);
+        }
+        else if (arg == ARG_DOUBLE)
+        {
+            double value = va_arg(list, double);
+            memcpy(&args[size], &value, sizeof(value));
+            size += sizeof(value);
+        }
+        else
+        {
+            void *value = va_arg(list, void *);
+            memcpy(&args[size], &value, sizeof(value));
+            size += sizeof(value);
+        }
+    }
+
+    return size;
+}
+
+static FILE *stream_of(int level)
+{
+    return level <= LOG_WARN ? stderr : stdout;
+}
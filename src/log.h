@@ -0,0 +1,122 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOG_ERROR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+// Calls above this level are compiled out, arguments are not evaluated but
+// still count as used and are still checked against the format
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO
+#endif
+
+#define LOG_RECORDS 4096    // Records per producer ring, power of two
+#define LOG_ARGS_SIZE 240   // Bytes of packed arguments per record
+#define LOG_STRING_MAX 128  // Longest string argument kept, longer ones are cut and end in "..."
+#define LOG_PRODUCERS 16    // Threads that can log through a ring
+
+#define log_error(...) log_write(LOG_ERROR, __VA_ARGS__)
+
+#if LOG_LEVEL >= LOG_WARN
+#define log_warn(...) log_write(LOG_WARN, __VA_ARGS__)
+#else
+#define log_warn(...) ((void)sizeof(log_discard(__VA_ARGS__)))
+#endif
+
+#if LOG_LEVEL >= LOG_INFO
+#define log_info(...) log_write(LOG_INFO, __VA_ARGS__)
+#else
+#define log_info(...) ((void)sizeof(log_discard(__VA_ARGS__)))
+#endif
+
+#if LOG_LEVEL >= LOG_DEBUG
+#define log_debug(...) log_write(LOG_DEBUG, __VA_ARGS__)
+#else
+#define log_debug(...) ((void)sizeof(log_discard(__VA_ARGS__)))
+#endif
+
+/**
+ * @defgroup log log.h
+ * @brief The header file for the functions used in logging.
+ * A thread that logs through a ring only stores the format and its
+ * arguments in a record, a background thread formats the records and
+ * writes them, warnings and errors to stderr and the rest to stdout.
+ * Every producer thread has a ring of its own, so neither side takes a
+ * lock. When a ring is full the record is dropped and counted instead of
+ * waiting for the background thread. The background thread sleeps while
+ * every ring is empty and is woken by the first record after that.
+ *
+ * The format must be a string literal, or live as long as the program,
+ * since only a pointer to it is kept. Conversions are those of printf
+ * without "*" widths and precisions. String arguments are copied, up to
+ * LOG_STRING_MAX bytes.
+ *
+ * A thread that has no ring, or logs before "log_start" or after
+ * "log_stop", writes directly.
+ *
+ * @{
+ */
+
+/**
+ * @brief Starts the background thread and gives the calling thread a ring.
+ *
+ * "log_stop" is registered with atexit, so records are written even when
+ * the program ends with exit.
+ *
+ * @param Void
+ * @return Bool False if the thread could not be started, logging is then
+ * direct.
+ */
+bool log_start(void);
+
+/**
+ * @brief Gives the calling thread a ring of its own.
+ *
+ * @param Void
+ * @return Bool False if all LOG_PRODUCERS rings are taken, logging is then
+ * direct for this thread.
+ */
+bool log_attach(void);
+
+/**
+ * @brief Writes the records that are left and stops the background thread.
+ *
+ * Calling it again does nothing.
+ *
+ * @param Void
+ * @return Void
+ */
+void log_stop(void);
+
+/**
+ * @brief Logs a line at the given level, use the log_* macros instead.
+ *
+ * @param int LOG_ERROR, LOG_WARN, LOG_INFO or LOG_DEBUG.
+ * @param Char* A printf format.
+ * @return Void
+ */
+void log_write(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Never called, only named by the log_* macros that are compiled out.
+ */
+int log_discard(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * @brief Returns the number of records dropped because a ring was full.
+ *
+ * @param Void
+ * @return uint64_t Dropped records in all rings.
+ */
+uint64_t log_dropped(void);
+
+/**
+ * @}
+ */
+
+#endif /* LOG_H */
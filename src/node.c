@@ -5,6 +5,8 @@
 void sig_handler(int signum);
 
 static void check_params(int argc);
+static void loadConfig(NodeConfig *config);
+static int configValue(const char *name, int defaultValue, int minimum);
 static void exit_on_error(const char *title, struct NetNode *netNode);
 static void exit_on_error_custom(const char *title, const char *detail);
 static eSystemEvent readEvent(struct NetNode *netNode, eSystemState state);
@@ -14,7 +16,7 @@ static bool nodeConnected(struct NetNode *netNode);
 static void initTCPSocketC(struct NetNode *netNode);
 static void writeNetJoinResponse(unsigned char *destMessage, struct NetNode *netNode, struct sockaddr_in nextAddr, uint8_t minS, uint8_t maxS);
 static void writeNetJoinMessage(unsigned char *destMessage, struct sockaddr_in addr, unsigned char range);
-static int writeLookupResponse(unsigned char *destMessage, unsigned char *ssn, unsigned char *name, unsigned char *email, struct NetNode *netNode);
+static int writeLookupResponse(unsigned char *destMessage, unsigned char *ssn, unsigned char *name, unsigned char *email);
 static void writeValInsertMessage(unsigned char *message, const char *ssn, const char *name, const char *email);
 static void writeNetLeavingMessage(unsigned char *message, struct sockaddr_in addr);
 static void writeArgvMessage(unsigned char *message, char *addr, char *port);
@@ -22,17 +24,97 @@ static struct STUN_RESPONSE_PDU readStunResponse(unsigned char *message);
 static struct NET_JOIN_PDU readNetJoinMessage(unsigned char *message);
 static struct NET_JOIN_RESPONSE_PDU readNetJoinResponse(unsigned char *message);
 static struct NET_GET_NODE_RESPONSE_PDU readNetGetNodeResponse(unsigned char *message);
-static struct VAL_INSERT_PDU *readValInsertMessage(unsigned char *message);
+static size_t readValInsertMessage(unsigned char *message, size_t size, struct VAL_INSERT_PDU *insertMessage);
 static struct VAL_LOOKUP_PDU readLookupMessage(unsigned char *message);
+static struct VAL_LOOKUP_MULTI_PDU readLookupMultiMessage(unsigned char *message);
 static struct NET_NEW_RANGE_PDU readNewRange(unsigned char *message);
 static struct NET_LEAVING_PDU readNetLeavingMessage(unsigned char *message);
 static void transferUpperRange(struct NetNode *netNode, uint8_t minS, uint8_t maxS);
+static size_t transferBucket(struct NetNode *netNode, hash_t bucket, struct InsertBatch *batch);
+static void insertEntry(Store *store, struct VAL_INSERT_PDU *insertMessage, char *name, char *email);
+static void deliverEntry(struct NetNode *netNode, hash_t hash, unsigned char *message, size_t size);
+static int applyEntry(Store *store, unsigned char *message, size_t size, unsigned char *response, struct sockaddr_in *responseAddr);
+static void createStores(struct NetNode *netNode);
+static void destroyStores(struct NetNode *netNode);
+static void rebuildFilters(struct NetNode *netNode);
+static Store *storeOf(struct NetNode *netNode, hash_t hash);
+static size_t entryCount(struct NetNode *netNode);
+static size_t entryMemory(struct NetNode *netNode);
+static void handleShardMessage(Worker *worker, void *message, size_t size, void *context);
+static void countShard(struct Shard *shard);
+static void postToShard(struct NetNode *netNode, struct Shard *shard, const unsigned char *message, size_t size);
+static void takeShardReplies(struct NetNode *netNode, struct Shard *shard);
+static void takeReplies(struct NetNode *netNode);
+static void postPending(struct Shard *shard);
+static void waitReplies(struct NetNode *netNode);
+static void quiesceShards(struct NetNode *netNode);
+static void insertBatch(struct NetNode *netNode);
+static void batchAppend(struct NetNode *netNode, struct InsertBatch *batch, const unsigned char *record, size_t recordSize);
+static void batchFlush(struct NetNode *netNode, struct InsertBatch *batch);
+static void lookupMulti(struct NetNode *netNode);
 static uint32_t deserializeUint32(unsigned char *message);
 static uint16_t deserializeUint16(unsigned char *message);
 static void serializeUint16(unsigned char *message, uint16_t value);
 static void serializeUint32(unsigned char *message, uint32_t value);
-static void removeMsgFromBuffer(unsigned char *buffer, int size);
-static void printAddress(struct sockaddr_in addr);
+static void serializeUint64(unsigned char *message, uint64_t value);
+static ssize_t frameSize(const Ring *ring, size_t offset);
+static bool nextMessage(struct NetNode *netNode);
+static bool nextStateMessage(struct NetNode *netNode);
+static bool handleTimers(struct NetNode *netNode, const Event *events, int count);
+static void sendAlive(struct NetNode *netNode);
+static void writeRangeUpdate(unsigned char *message, Range range, struct sockaddr_in addr, uint8_t hopsLeft);
+static struct NET_RANGE_UPDATE_PDU readRangeUpdate(unsigned char *message);
+static void announceRange(struct NetNode *netNode);
+static void updateRingMap(struct NetNode *netNode);
+static const struct sockaddr_in *ownerOf(struct NetNode *netNode, hash_t hash);
+static size_t writeRangeMap(unsigned char *message, struct NetNode *netNode);
+static void sendRangeMap(struct NetNode *netNode);
+static bool routeClockwise(struct NetNode *netNode, hash_t hash);
+static const struct sockaddr_in *closestFinger(struct NetNode *netNode, hash_t hash, bool clockwise);
+static void printHops(struct NetNode *netNode);
+static eSystemState handlerState(pfEventHandler handler);
+static size_t writeStats(unsigned char *message, struct NetNode *netNode);
+static void sendStats(struct NetNode *netNode);
+static void consumeMessage(struct NetNode *netNode);
+static bool socketReadable(struct NetNode *netNode, int socket);
+static void receiveFromSocket(struct NetNode *netNode, int socket);
+static void receiveDatagrams(struct NetNode *netNode, int socket);
+static void takeReceived(struct NetNode *netNode, int socket);
+static void appendDatagram(struct NetNode *netNode, int socket, const unsigned char *data, size_t size, bool truncated);
+static bool passThrough(struct NetNode *netNode);
+static size_t peekFrame(int fd, unsigned char *header, size_t available);
+static void spliceToSuccessor(struct NetNode *netNode, size_t size);
+static void queueResponse(struct NetNode *netNode, const unsigned char *message, size_t size, struct sockaddr_in addr, bool gather);
+static void flushResponses(struct NetNode *netNode);
+static void closeSocket(struct NetNode *netNode, int socket);
+static void updateInterest(struct NetNode *netNode, int socket);
+static void setNonBlocking(struct NetNode *netNode, int fd);
+static void sendToSocket(struct NetNode *netNode, int socket, const void *message, size_t size);
+static void flushTimeout(struct NetNode *netNode, int socket);
+static struct EntryExpiry **findExpiry(struct NetNode *netNode, const char *ssn);
+static void armExpiry(struct NetNode *netNode, const char *ssn);
+static void dropExpiry(struct NetNode *netNode, struct EntryExpiry *expiry);
+static void dropBucketExpiries(struct NetNode *netNode, hash_t bucket);
+static void expireEntry(struct NetNode *netNode, struct EntryExpiry *expiry);
+static void sendDatagram(struct NetNode *netNode, int socket, const void *message, size_t size, struct sockaddr_in addr, const char *error);
+static bool flushSocket(struct NetNode *netNode, int socket);
+static int sendQueue(int fd, Ring *tx, size_t *sent);
+static void shrinkQueue(Ring *tx);
+static bool lingerSocket(struct NetNode *netNode, int socket);
+static void flushLingering(struct NetNode *netNode, int slot);
+static void closeLingering(struct NetNode *netNode, int slot);
+static void lingerTimeout(struct NetNode *netNode, int slot);
+static int lingeringSockets(struct NetNode *netNode);
+static void drainLingering(struct NetNode *netNode);
+static bool sendBacklogged(struct NetNode *netNode);
+static void connectSocket(struct NetNode *netNode, int slot);
+static bool finishConnect(struct NetNode *netNode, int socket);
+static void acceptPredecessor(struct NetNode *netNode);
+static void finishAccept(struct NetNode *netNode);
+static void startHandshakeTimer(struct NetNode *netNode, int socket);
+static void stopHandshakeTimer(struct NetNode *netNode, int socket);
+static void handshakeTimeout(struct NetNode *netNode, int socket);
+static int bytesPerEntry(struct NetNode *netNode);
 
 // --------- DEBUG FUNCTIONS ----------- //
 // static void fprintNetJoinResponse(unsigned char *response);
@@ -61,6 +143,12 @@ static afEventHandler stateMachine = {
 	[q16] = {[eventDone] = gotoStateQ6},
 	[q17] = {[eventDone] = gotoStateQ6}};
 
+// gotoStateQn at index qn, to know which handler a transition runs
+static const pfEventHandler handlers[lastState] = {
+	[q1] = gotoStateQ1, [q2] = gotoStateQ2, [q3] = gotoStateQ3, [q4] = gotoStateQ4, [q5] = gotoStateQ5, [q6] = gotoStateQ6,
+	[q7] = gotoStateQ7, [q8] = gotoStateQ8, [q9] = gotoStateQ9, [q10] = gotoStateQ10, [q11] = gotoStateQ11, [q12] = gotoStateQ12,
+	[q13] = gotoStateQ13, [q14] = gotoStateQ14, [q15] = gotoStateQ15, [q16] = gotoStateQ16, [q17] = gotoStateQ17, [q18] = gotoStateQ18};
+
 int main(int argc, char **argv)
 {
 	eSystemState nextState = firstState;
@@ -68,16 +156,70 @@ int main(int argc, char **argv)
 
 	check_params(argc);
 	signal(SIGINT, sig_handler);
+	//Unlike sendmsg, splice has no MSG_NOSIGNAL
+	signal(SIGPIPE, SIG_IGN);
+	log_start();
 
 	struct NetNode netNode = {};
 	memset(&netNode, 0, sizeof(netNode));
+	loadConfig(&netNode.config);
+
+	netNode.pduScratch = calloc(BUFF_SIZE, sizeof(unsigned char));
+	if (netNode.pduScratch == NULL)
+	{
+		exit_on_error("Calloc error", &netNode);
+	}
+	netNode.pduMessage = netNode.pduScratch;
+	netNode.pduSocket = -1;
 
-	netNode.pduMessage = calloc(BUFF_SIZE, sizeof(unsigned char));
-	if (netNode.pduMessage == NULL)
+	netNode.udpScratch = malloc(UDP_BATCH * BATCH_SIZE);
+	netNode.responses = calloc(1, sizeof(struct ResponseBatch));
+	netNode.stats = calloc(1, sizeof(struct NodeStats));
+	if (netNode.udpScratch == NULL || netNode.responses == NULL || netNode.stats == NULL)
 	{
 		exit_on_error("Calloc error", &netNode);
 	}
 
+	for (int i = 0; i < NO_SOCKETS; i++)
+	{
+		netNode.rx[i] = ring_create(i == UDP_SOCKET_A || i == UDP_SOCKET_A2 ? UDP_RX_SIZE : RX_SIZE);
+		netNode.tx[i] = ring_create(TX_SIZE);
+		event_timer_init(&netNode.handshakeTimer[i]);
+		event_timer_init(&netNode.flushTimer[i]);
+	}
+	for (int i = 0; i < LINGER_SOCKETS; i++)
+	{
+		netNode.lingering[i].tx = ring_create(TX_SIZE);
+		event_timer_init(&netNode.lingering[i].timer);
+	}
+	event_timer_init(&netNode.aliveTimer);
+
+	netNode.loop = event_loop_create(netNode.config.ioUring ? EVENT_BACKEND_URING : EVENT_BACKEND_EPOLL);
+	if (netNode.loop == NULL)
+	{
+		exit_on_error("Could not create event loop", &netNode);
+	}
+	if (netNode.config.ioUring && event_loop_backend(netNode.loop) != EVENT_BACKEND_URING)
+	{
+		log_warn("io_uring is not available, using epoll\n");
+	}
+
+	//Sockets that receive through io_uring can not be spliced from
+	if (event_loop_backend(netNode.loop) == EVENT_BACKEND_EPOLL && pipe2(netNode.passPipe, O_NONBLOCK | O_CLOEXEC) == 0)
+	{
+		fcntl(netNode.passPipe[1], F_SETPIPE_SZ, PASS_PIPE_SIZE);
+	}
+	event_timer_start(netNode.loop, &netNode.aliveTimer, TIMER_ALIVE, netNode.config.aliveInterval, netNode.config.aliveInterval);
+
+	if (netNode.config.workers > 0)
+	{
+		netNode.replyFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (netNode.replyFd == -1 || !event_loop_watch(netNode.loop, netNode.replyFd, EVENT_READ, WORKER_REPLIES))
+		{
+			exit_on_error("Could not watch worker replies", &netNode);
+		}
+	}
+
 	writeArgvMessage(netNode.pduMessage, argv[1], argv[2]);
 
 	while (true)
@@ -86,21 +228,40 @@ int main(int argc, char **argv)
 
 		if ((nextState < lastState) && (newEvent < lastEvent) && stateMachine[nextState][newEvent] != NULL)
 		{
-			nextState = (*stateMachine[nextState][newEvent])(&netNode);
+			pfEventHandler handler = stateMachine[nextState][newEvent];
+			eSystemState handled = handlerState(handler);
+			netNode.stats->events[newEvent]++;
+			PROBE3(handler_start, nextState, newEvent, handled);
+
+			uint64_t start = event_now_ns();
+			nextState = (*handler)(&netNode);
+			uint64_t elapsed = event_now_ns() - start;
+			PROBE3(handler_done, handled, nextState, elapsed);
+			//exitState frees the stats
+			if (handled != lastState)
+			{
+				histogram_record(&netNode.stats->handlers[handled], elapsed);
+			}
 			if (nextState != q6)
 			{
 				if (nextState == lastState) {break;}
-				printf("[Q%d]\n", nextState);
+				log_debug("[Q%d]\n", nextState);
 			}
 		}
 		else
 		{
 			if (nextState == lastState || newEvent == eventShutDown) {break;}
-			fprintf(stderr, "Invalid state Q%d or event E%d\n", nextState, newEvent);
+			log_error("Invalid state Q%d or event E%d\n", nextState, newEvent);
 			break;
 		}
 	}
 
+	//Leaving the ring ends here, send what is still queued before closing
+	if (nextState != lastState)
+	{
+		exitState(&netNode);
+	}
+
 	return 0;
 }
 
@@ -112,12 +273,51 @@ static void check_params(int argc)
 	}
 }
 
+// Tunables from the environment, anything unset or invalid keeps its default
+static void loadConfig(NodeConfig *config)
+{
+	config->socketBudget = configValue("NODE_SOCKET_BUDGET", SOCKET_BUDGET, 1);
+	config->handshakeTimeout = configValue("NODE_HANDSHAKE_TIMEOUT_MS", HANDSHAKE_TIMEOUT_MS, 1);
+	config->flushBytes = configValue("NODE_FLUSH_BYTES", FLUSH_BYTES, 1);
+	config->flushDelay = configValue("NODE_FLUSH_DELAY_MS", FLUSH_DELAY_MS, 0);
+	config->aliveInterval = configValue("NODE_ALIVE_INTERVAL_MS", ALIVE_INTERVAL_MS, 1);
+	config->entryTtl = configValue("NODE_ENTRY_TTL_MS", ENTRY_TTL_MS, 0);
+	config->workers = configValue("NODE_WORKERS", WORKERS, 0);
+	if (config->workers > MAX_WORKERS)
+	{
+		log_warn("Using %d workers, the most there can be\n", MAX_WORKERS);
+		config->workers = MAX_WORKERS;
+	}
+	config->ioUring = configValue("NODE_IO_URING", IO_URING, 0);
+}
+
+// The value of an environment variable, at least "minimum"
+static int configValue(const char *name, int defaultValue, int minimum)
+{
+	const char *text = getenv(name);
+	if (text == NULL)
+	{
+		return defaultValue;
+	}
+
+	char *end;
+	long value = strtol(text, &end, 10);
+	if (*text == '\0' || *end != '\0' || value < minimum || value > INT32_MAX)
+	{
+		log_warn("Ignoring %s=%s, using %d\n", name, text, defaultValue);
+		return defaultValue;
+	}
+	return (int)value;
+}
+
 static void exit_on_error(const char *title, struct NetNode *netNode)
 {
 	if (errno != EINTR)
 	{
+		//Closing the sockets may change errno
+		int error = errno;
 		exitState(netNode);
-		perror(title);
+		log_error("%s: %s\n", title, strerror(error));
 		exit(1);
 	}
 }
@@ -126,7 +326,7 @@ static void exit_on_error_custom(const char *title, const char *detail)
 {
 	if (errno != EINTR)
 	{
-		fprintf(stderr, "%s:%s\n", title, detail);
+		log_error("%s:%s\n", title, detail);
 		exit(1);
 	}
 }
@@ -172,86 +372,127 @@ static eSystemEvent readEvent(struct NetNode *netNode, eSystemState state)
 		}
 		else
 		{
-			printf("\tI am the last node, bye!\n");
+			log_info("\tI am the last node, bye!\n");
 			return eventNotConnected;
 		}
 	default:
-		if (netNode->pduMessage[0] != 0)
-		{ 	
-			//Messages left in buffer
-			return findRightEvent(netNode, netNode->pduMessage, BUFF_SIZE);
+	{
+		//Timers are due even when messages never stop arriving
+		Event expired[EXPIRED_BATCH];
+		int count = event_loop_expired(netNode->loop, expired, EXPIRED_BATCH);
+		if (handleTimers(netNode, expired, count))
+		{
+			return eventTimeout;
+		}
+
+		if (netNode->pduSize > 0 || nextStateMessage(netNode))
+		{
+			return findRightEvent(netNode, netNode->pduMessage, netNode->pduSize);
 		}
 		else
 		{
 			return readFromSockets(netNode);
 		}
 	}
+	}
 }
 
 static eSystemEvent readFromSockets(struct NetNode *netNode)
 {
-	int timeoutMs = 5000;
-	int timeoutCount = 0;
-	int returnValue;
-	unsigned char buffer[BUFF_SIZE];
-	memset(buffer, 0, BUFF_SIZE);
-	ssize_t bytesRead = 0;
+	Event events[NO_SOCKETS + 1 + LINGER_SOCKETS + EXPIRED_BATCH]; //Sockets, worker replies, lingering sockets and timers
+	bool timeout = false;
 
-	netNode->fds[UDP_SOCKET_A].events = POLLIN;
-	netNode->fds[TCP_SOCKET_B].events = POLLIN;
-	netNode->fds[TCP_SOCKET_C].events = POLLIN;
-	netNode->fds[TCP_SOCKET_D].events = POLLIN;
-	netNode->fds[UDP_SOCKET_A2].events = POLLIN;
+	while (true)
+	{
+		//Nothing left to handle, send everything that was queued
+		takeReplies(netNode);
+		flushResponses(netNode);
+		for (int i = 0; i < NO_SOCKETS; i++)
+		{
+			if (netNode->fds[i].fd != 0 && ring_length(netNode->tx[i]) > 0)
+			{
+				flushSocket(netNode, i);
+			}
+			updateInterest(netNode, i);
+		}
 
-	returnValue = poll(netNode->fds, NO_SOCKETS, timeoutMs);
+		int count = event_loop_wait(netNode->loop, events, NO_SOCKETS + 1 + LINGER_SOCKETS + EXPIRED_BATCH, -1);
+		if (count == -1)
+		{
+			if (errno == EINTR)
+			{
+				errno = 0;
+				return eventShutDown;
+			}
+			exit_on_error("Event loop error", netNode);
+		}
 
-	if (returnValue == -1)
-	{
-		exit_on_error("Poll error", netNode);
-	}
-	else if (errno == EINTR)
-	{
-		errno = 0;
-		return eventShutDown;
-	}
+		int error;
+		int failed = event_loop_failed_sends(netNode->loop, &error);
+		if (failed > 0)
+		{
+			log_warn("Could not send %d datagrams: %s\n", failed, strerror(error));
+		}
 
-	if (returnValue > 0)
-	{
-		for (int i = 0; i < NO_SOCKETS; i++)
+		//Drain every ready socket before handling any message
+		timeout = handleTimers(netNode, events, count);
+		for (int n = 0; n < count; n++)
 		{
-			if (netNode->fds[i].revents & POLLIN)
+			int socket = events[n].tag;
+			if (events[n].flags & EVENT_TIMER)
 			{
-				bytesRead = read(netNode->fds[i].fd, buffer, BUFF_SIZE);
-				if (bytesRead > 0)
+				continue;
+			}
+			if (socket == WORKER_REPLIES)
+			{
+				uint64_t signals;
+				if (read(netNode->replyFd, &signals, sizeof(signals)) == sizeof(signals))
 				{
-					//Copy buffer to message buffer
-					memcpy(netNode->pduMessage, buffer, bytesRead);
-					return findRightEvent(netNode, buffer, bytesRead);
+					takeReplies(netNode);
 				}
+				continue;
+			}
+			if (socket >= LINGERING)
+			{
+				flushLingering(netNode, socket - LINGERING);
+				continue;
+			}
+			if (socket == TCP_SOCKET_C)
+			{
+				finishAccept(netNode);
+				continue;
+			}
+			if (netNode->connecting[socket] && !finishConnect(netNode, socket))
+			{
+				continue;
+			}
+			if (events[n].flags & EVENT_WRITE)
+			{
+				flushSocket(netNode, socket);
+			}
+			if ((events[n].flags & (EVENT_READ | EVENT_ERROR)) && socketReadable(netNode, socket))
+			{
+				receiveFromSocket(netNode, socket);
 			}
 		}
-		return findRightEvent(netNode, buffer, bytesRead);
-	}
-	else
-	{
-		if (timeoutCount % 3 == 0)
+
+		//Received messages stay in the rings until the timeout is handled
+		if (timeout)
 		{
 			return eventTimeout;
 		}
-		else
+		if (nextStateMessage(netNode))
 		{
-			printf("[Q6] (%d entries stored)\n", list_get_length(netNode->entries));
+			return findRightEvent(netNode, netNode->pduMessage, netNode->pduSize);
 		}
-		timeoutCount++;
 	}
-
-	return lastEvent;
 }
 
 static eSystemEvent findRightEvent(struct NetNode *netNode, unsigned char *buffer, ssize_t buffSize)
 {
 	struct NET_GET_NODE_RESPONSE_PDU getNodeResponse;
 
+	PROBE3(pdu_received, buffer[0], buffSize, netNode->pduSocket);
 	switch (buffer[0])
 	{
 	case STUN_RESPONSE:
@@ -262,8 +503,10 @@ static eSystemEvent findRightEvent(struct NetNode *netNode, unsigned char *buffe
 	case NET_JOIN_RESPONSE:
 		return eventJoinResponse;
 	case VAL_INSERT:
+	case VAL_INSERT_BATCH:
 		return eventInsert;
 	case VAL_LOOKUP:
+	case VAL_LOOKUP_MULTI:
 		return eventLookup;
 	case VAL_REMOVE:
 		return eventRemove;
@@ -278,7 +521,7 @@ static eSystemEvent findRightEvent(struct NetNode *netNode, unsigned char *buffe
 	case NET_NEW_RANGE_RESPONSE:
 		return eventNewRangeResponse;
 	default:
-		fprintf(stderr, "Unknown response: %d\n", buffer[0]);
+		log_warn("Unknown response: %d\n", buffer[0]);
 		return lastEvent;
 	}
 }
@@ -315,22 +558,16 @@ eSystemState gotoStateQ1(struct NetNode *netNode)
 	unsigned char lookupMessage[1] = {'\0'};
 	size_t lookupSize = sizeof(lookupMessage);
 	lookupMessage[0] = STUN_LOOKUP;
-	socklen_t UDPAddressLen = sizeof(netNode->fdsAddr[UDP_SOCKET_A]);
 
-	if (sendto(netNode->fds[UDP_SOCKET_A].fd, lookupMessage, lookupSize, 0, (struct sockaddr *)&netNode->fdsAddr[UDP_SOCKET_A], UDPAddressLen) == -1)
-	{
-		exit_on_error("Could not send to tracker with UDP", netNode);
-	}
+	sendDatagram(netNode, UDP_SOCKET_A, lookupMessage, lookupSize, netNode->fdsAddr[UDP_SOCKET_A], "Could not send to tracker with UDP");
 
-	removeMsgFromBuffer(netNode->pduMessage, 1 + addrLen + portLen);
+	consumeMessage(netNode);
 	return q1;
 }
 
 eSystemState gotoStateQ2(struct NetNode *netNode)
 {
-	printf("\tNode started, sending STUN_LOOKUP to tacker: V4(");
-	printAddress(netNode->fdsAddr[UDP_SOCKET_A]);
-	printf(")\n");
+	log_info("\tNode started, sending STUN_LOOKUP to tacker: V4(%s:%d)\n", inet_ntoa(netNode->fdsAddr[UDP_SOCKET_A].sin_addr), ntohs(netNode->fdsAddr[UDP_SOCKET_A].sin_port));
 
 	return q2;
 }
@@ -340,20 +577,24 @@ eSystemState gotoStateQ3(struct NetNode *netNode)
 	struct STUN_RESPONSE_PDU stunResponse = readStunResponse(netNode->pduMessage);
 	struct sockaddr_in myAddr;
 	myAddr.sin_addr.s_addr = htonl(stunResponse.address);
-	printf("\tGot STUN_RESPONSE, my address is: %s\n", inet_ntoa(myAddr.sin_addr));
+	log_info("\tGot STUN_RESPONSE, my address is: %s\n", inet_ntoa(myAddr.sin_addr));
+
+	//Others reach our UDP socket at the STUN address and its local port
+	socklen_t udpAddrLen = sizeof(netNode->udpAddr);
+	if (getsockname(netNode->fds[UDP_SOCKET_A].fd, (struct sockaddr *)&netNode->udpAddr, &udpAddrLen) == -1)
+	{
+		exit_on_error("getsockname error", netNode);
+	}
+	netNode->udpAddr.sin_addr.s_addr = myAddr.sin_addr.s_addr;
 
 	//Send NET_GET_NODE
 	unsigned char getNodeMessage[1] = {'\0'};
 	size_t messageSize = sizeof(getNodeMessage);
 	getNodeMessage[0] = NET_GET_NODE;
-	socklen_t addrLength = sizeof(netNode->fdsAddr[UDP_SOCKET_A]);
 
-	if (sendto(netNode->fds[UDP_SOCKET_A].fd, getNodeMessage, messageSize, 0, (struct sockaddr *)&netNode->fdsAddr[UDP_SOCKET_A], addrLength) == -1)
-	{
-		exit_on_error("Could not send to Tracker with UDP", netNode);
-	}
+	sendDatagram(netNode, UDP_SOCKET_A, getNodeMessage, messageSize, netNode->fdsAddr[UDP_SOCKET_A], "Could not send to Tracker with UDP");
 
-	removeMsgFromBuffer(netNode->pduMessage, STUN_RESP_SIZE);
+	consumeMessage(netNode);
 	return q3;
 }
 
@@ -361,11 +602,11 @@ eSystemState gotoStateQ4(struct NetNode *netNode)
 {
 	netNode->nodeRange.min = 0;
 	netNode->nodeRange.max = 255;
-	netNode->entries = list_create();
+	createStores(netNode);
 
-	printf("\tI am the first node to join the network\n");
+	log_info("\tI am the first node to join the network\n");
 
-	removeMsgFromBuffer(netNode->pduMessage, GET_NODE_RESP_SIZE);
+	consumeMessage(netNode);
 	return q4;
 }
 
@@ -378,21 +619,9 @@ eSystemState gotoStateQ5(struct NetNode *netNode)
 	netNode->fdsAddr[TCP_SOCKET_B].sin_family = AF_INET;
 	netNode->fdsAddr[TCP_SOCKET_B].sin_addr.s_addr = htonl(joinRequest.src_address);
 	netNode->fdsAddr[TCP_SOCKET_B].sin_port = htons(joinRequest.src_port);
-	socklen_t addrLenB = sizeof(netNode->fdsAddr[TCP_SOCKET_B]);
-
-	netNode->fds[TCP_SOCKET_B].fd = socket(AF_INET, SOCK_STREAM, 0);
-	if (netNode->fds[TCP_SOCKET_B].fd == -1)
-	{
-		exit_on_error("Could not open socket to successor", netNode);
-	}
-
-	if (connect(netNode->fds[TCP_SOCKET_B].fd, (struct sockaddr *)&netNode->fdsAddr[TCP_SOCKET_B], addrLenB) == -1)
-	{
-		exit_on_error("Could not connect to successor", netNode);
-	}
 
-	printf("\tConnected to new successor V4(");
-	printAddress(netNode->fdsAddr[TCP_SOCKET_B]);
+	log_info("\tConnecting to new successor V4(%s:%d)\n", inet_ntoa(netNode->fdsAddr[TCP_SOCKET_B].sin_addr), ntohs(netNode->fdsAddr[TCP_SOCKET_B].sin_port));
+	connectSocket(netNode, TCP_SOCKET_B);
 
 	// Open socket
 	if (netNode->fds[TCP_SOCKET_C].fd == 0) //Socket C not initialized yet
@@ -409,56 +638,36 @@ eSystemState gotoStateQ5(struct NetNode *netNode)
 	netNode->nodeRange.min = minP;
 	netNode->nodeRange.max = maxP;
 
-	printf("\tOther hash-range is (%d, %d)\n", minS, maxS);
-	printf("\tNew hash-range is (%d, %d)\n", netNode->nodeRange.min, netNode->nodeRange.max);
+	log_info("\tOther hash-range is (%d, %d)\n", minS, maxS);
+	log_info("\tNew hash-range is (%d, %d)\n", netNode->nodeRange.min, netNode->nodeRange.max);
 
 	//Send NET_JOIN_RESPONSE
 	unsigned char netJoinResponseMessage[9] = {'\0'};
 	size_t messageSize = sizeof(netJoinResponseMessage);
 	writeNetJoinResponse(netJoinResponseMessage, netNode, netNode->fdsAddr[TCP_SOCKET_C], minS, maxS);
 
-	if (send(netNode->fds[TCP_SOCKET_B].fd, netJoinResponseMessage, messageSize, 0) == -1)
-	{
-		exit_on_error("Could not send to successor", netNode);
-	}
-
-	// Accept predecessor
-	if (listen(netNode->fds[TCP_SOCKET_C].fd, 1) == -1)
-	{
-		exit_on_error("Did not hear anything from my connection socket", netNode);
-	}
+	sendToSocket(netNode, TCP_SOCKET_B, netJoinResponseMessage, messageSize);
 
-	socklen_t addrLenD = sizeof(netNode->fdsAddr[TCP_SOCKET_D]);
-	netNode->fds[TCP_SOCKET_D].fd = accept(netNode->fds[TCP_SOCKET_C].fd, (struct sockaddr *)&netNode->fdsAddr[TCP_SOCKET_D], &addrLenD);
-	if (netNode->fds[TCP_SOCKET_D].fd == -1)
-	{
-		exit_on_error("Could not accept from my predecessor", netNode);
-	}
+	//The new node connects back as predecessor
+	acceptPredecessor(netNode);
 
 	//Transfer upper half of entry-range to successor
 	transferUpperRange(netNode, minS, maxS);
+	announceRange(netNode);
 
-	printf("\tAccept new predecessor V4(");
-	printAddress(netNode->fdsAddr[TCP_SOCKET_D]);
-	printf(")\n");
-
-	removeMsgFromBuffer(netNode->pduMessage, JOIN_SIZE);
+	consumeMessage(netNode);
 	return q5;
 }
 
 eSystemState gotoStateQ6(struct NetNode *netNode)
 {
-	printf("[Q6] (%d entries stored) (%d, %d)\n", list_get_length(netNode->entries), netNode->nodeRange.min, netNode->nodeRange.max);
-
-	//Send NET_ALIVE
-	unsigned char netAliveMessage[1] = {'\0'};
-	size_t messageSize = sizeof(netAliveMessage);
-	socklen_t addrLength = sizeof(netNode->fdsAddr[UDP_SOCKET_A]);
-	netAliveMessage[0] = NET_ALIVE;
+	log_debug("[Q6] (%d entries stored, %d bytes/entry) (%d, %d)\n", (int)entryCount(netNode), bytesPerEntry(netNode), netNode->nodeRange.min, netNode->nodeRange.max);
 
-	if (sendto(netNode->fds[UDP_SOCKET_A].fd, netAliveMessage, messageSize, 0, (struct sockaddr *)&netNode->fdsAddr[UDP_SOCKET_A], addrLength) == -1)
+	//Tell the tracker right away that we joined, the alive timer keeps it up to date
+	if (!netNode->alive)
 	{
-		exit_on_error("Could not send NET_ALIVE to tracker", netNode);
+		netNode->alive = true;
+		sendAlive(netNode);
 	}
 
 	return q6;
@@ -484,181 +693,91 @@ eSystemState gotoStateQ7(struct NetNode *netNode)
 	unsigned char netJoinMessage[JOIN_SIZE] = {'\0'};
 	size_t messageSize = sizeof(netJoinMessage);
 	writeNetJoinMessage(netJoinMessage, netNode->fdsAddr[TCP_SOCKET_C], 0);
-	socklen_t udpAddressLen = sizeof(netNode->fdsAddr[UDP_SOCKET_A2]);
-
-	printf("\tI am not the first node, sending NET_JOIN to V4(");
-	printAddress(netNode->fdsAddr[UDP_SOCKET_A2]);
-	printf(")\n");
 
-	if (sendto(netNode->fds[UDP_SOCKET_A2].fd, netJoinMessage, messageSize, 0, (struct sockaddr *)&netNode->fdsAddr[UDP_SOCKET_A2], udpAddressLen) == -1)
-	{
-		exit_on_error("Could not send to second UDP connection", netNode);
-	}
-
-	if (listen(netNode->fds[TCP_SOCKET_C].fd, 1) == -1)
-	{
-		exit_on_error("Could not hear anything from my open TCP", netNode);
-	}
+	log_info("\tI am not the first node, sending NET_JOIN to V4(%s:%d)\n", inet_ntoa(netNode->fdsAddr[UDP_SOCKET_A2].sin_addr), ntohs(netNode->fdsAddr[UDP_SOCKET_A2].sin_port));
 
-	socklen_t preNodeLen = sizeof(netNode->fdsAddr[TCP_SOCKET_D]);
-	netNode->fds[TCP_SOCKET_D].fd = accept(netNode->fds[TCP_SOCKET_C].fd, (struct sockaddr *)&netNode->fdsAddr[TCP_SOCKET_D], &preNodeLen);
-	if (netNode->fds[TCP_SOCKET_D].fd == -1)
-	{
-		exit_on_error("Could not accept from predecessor", netNode);
-	}
+	sendDatagram(netNode, UDP_SOCKET_A2, netJoinMessage, messageSize, netNode->fdsAddr[UDP_SOCKET_A2], "Could not send to second UDP connection");
 
-	printf("\tAccepted new predecessor V4(");
-	printAddress(netNode->fdsAddr[TCP_SOCKET_D]);
-	printf(")\n");
+	//NET_JOIN_RESPONSE arrives from the predecessor once it has connected
+	acceptPredecessor(netNode);
 
-	removeMsgFromBuffer(netNode->pduMessage, NET_GET_NODE_RESPONSE);
+	consumeMessage(netNode);
 	return q7;
 }
 
 eSystemState gotoStateQ8(struct NetNode *netNode)
 {
-	netNode->entries = list_create();
-
-	netNode->fds[TCP_SOCKET_B].fd = socket(AF_INET, SOCK_STREAM, 0);
-	if (netNode->fds[TCP_SOCKET_B].fd == -1)
-	{
-		exit_on_error("Could not open socket to successor", netNode);
-	}
+	createStores(netNode);
 
 	struct NET_JOIN_RESPONSE_PDU joinResponse = readNetJoinResponse(netNode->pduMessage);
 	netNode->fdsAddr[TCP_SOCKET_B].sin_family = AF_INET;
 	netNode->fdsAddr[TCP_SOCKET_B].sin_addr.s_addr = htonl(joinResponse.next_address);
 	netNode->fdsAddr[TCP_SOCKET_B].sin_port = htons(joinResponse.next_port);
-	socklen_t addrLenB = sizeof(netNode->fdsAddr[TCP_SOCKET_B]);
 
 	netNode->nodeRange.min = joinResponse.range_start;
 	netNode->nodeRange.max = joinResponse.range_end;
 
-	printf("\tGot NET_JOIN_RESPONSE from V4(");
-	printAddress(netNode->fdsAddr[TCP_SOCKET_D]);
-	printf("), my range is (%d, %d)\n", netNode->nodeRange.min, netNode->nodeRange.max);
-	printf("\tConnecting to successor V4(");
-	printAddress(netNode->fdsAddr[TCP_SOCKET_B]);
-	printf(")\n");
-	printf("\tConnecting to new successor V4(");
-	printAddress(netNode->fdsAddr[TCP_SOCKET_B]);
-	printf(")\n");
+	log_info("\tGot NET_JOIN_RESPONSE from V4(%s:%d), my range is (%d, %d)\n", inet_ntoa(netNode->fdsAddr[TCP_SOCKET_D].sin_addr), ntohs(netNode->fdsAddr[TCP_SOCKET_D].sin_port), netNode->nodeRange.min, netNode->nodeRange.max);
+	log_info("\tConnecting to successor V4(%s:%d)\n", inet_ntoa(netNode->fdsAddr[TCP_SOCKET_B].sin_addr), ntohs(netNode->fdsAddr[TCP_SOCKET_B].sin_port));
+	log_info("\tConnecting to new successor V4(%s:%d)\n", inet_ntoa(netNode->fdsAddr[TCP_SOCKET_B].sin_addr), ntohs(netNode->fdsAddr[TCP_SOCKET_B].sin_port));
+	connectSocket(netNode, TCP_SOCKET_B);
+	announceRange(netNode);
 
-	if (connect(netNode->fds[TCP_SOCKET_B].fd, (struct sockaddr *)&netNode->fdsAddr[TCP_SOCKET_B], addrLenB) == -1)
-	{
-		exit_on_error("Could not connect to successor", netNode);
-	}
-
-	removeMsgFromBuffer(netNode->pduMessage, JOIN_RESP_SIZE);
+	consumeMessage(netNode);
 	return q8;
 }
 
 eSystemState gotoStateQ9(struct NetNode *netNode)
 {
-	struct VAL_INSERT_PDU *insertMessage;
+	if (netNode->pduMessage[0] == VAL_INSERT_BATCH)
+	{
+		insertBatch(netNode);
+		consumeMessage(netNode);
+		return q9;
+	}
+	if (netNode->pduMessage[0] == VAL_LOOKUP_MULTI)
+	{
+		lookupMulti(netNode);
+		consumeMessage(netNode);
+		return q9;
+	}
+
+	struct VAL_INSERT_PDU insertMessage;
 	int messageSize = 0;
 	unsigned char ssn[SSN_LENGTH + 1] = {'\0'};
 	memcpy(ssn, &netNode->pduMessage[1], SSN_LENGTH);
 	hash_t hash = hash_ssn((char *)ssn);
 
-	if (hash >= netNode->nodeRange.min && hash <= netNode->nodeRange.max)
-	{ //If HASH(entry) is in node -> store/respond/delete
-		if (netNode->pduMessage[0] == VAL_INSERT)
+	if (netNode->pduMessage[0] == VAL_INSERT)
+	{ //Parse in place, name and email point into pduMessage
+		messageSize = readValInsertMessage(netNode->pduMessage, netNode->pduSize, &insertMessage);
+		if (messageSize == 0)
 		{
-			insertMessage = readValInsertMessage(netNode->pduMessage);
-
-			char name[insertMessage->name_length + 1];
-			char email[insertMessage->email_length + 1];
-
-			name[insertMessage->name_length] = '\0';
-			email[insertMessage->email_length] = '\0';
-
-			memcpy(name, insertMessage->name, insertMessage->name_length);
-			memcpy(email, insertMessage->email, insertMessage->email_length);
-
-			messageSize = 3 + SSN_LENGTH + insertMessage->name_length + insertMessage->email_length;
-
-			free(insertMessage->name);
-			free(insertMessage->email);
-			free(insertMessage);
-
-			list_insert(list_first(netNode->entries), (char *)ssn, email, name);
-			printf("\tInserting ssn Entry { ssn: \"%s\", name: \"%s\", email: \"%s\" }\n", ssn, name, email);
+			log_warn("Malformed VAL_INSERT, dropping it\n");
+			consumeMessage(netNode);
+			return q9;
 		}
-		else if (netNode->pduMessage[0] == VAL_REMOVE)
+	}
+
+	if (hash >= netNode->nodeRange.min && hash <= netNode->nodeRange.max)
+	{ //If HASH(entry) is in node -> store/respond/delete
+		netNode->hops.delivered++;
+		PROBE2(val_store, netNode->pduMessage[0], hash);
+		if (netNode->pduMessage[0] == VAL_REMOVE)
 		{
-			//Remove ssn if found
-			if (!list_is_empty(netNode->entries))
-			{
-				ListPos pos = list_first(netNode->entries);
-				while (!list_pos_equal(pos, list_end(netNode->entries)))
-				{ //Find ssn
-					const char *listSSN = list_inspect_ssn(pos);
-					if (strncmp((char *)ssn, (char *)listSSN, SSN_LENGTH) == 0)
-					{
-						//Remove index found
-						list_remove(pos);
-						printf("Removing ssn %s\n", ssn);
-						break;
-					}
-					pos = list_next(pos);
-				}
-			}
 			messageSize = REMOVE_SIZE;
 		}
-		else
-		{ //Do lookup
-			struct VAL_LOOKUP_PDU lookupMessage = readLookupMessage(netNode->pduMessage);
-			int bytesWritten = 0;
-			unsigned char lookupResponse[BUFF_SIZE];
-
-			if (!list_is_empty(netNode->entries))
-			{
-				ListPos pos = list_first(netNode->entries);
-
-				while (!list_pos_equal(pos, list_end(netNode->entries)))
-				{ //Find ssn
-					const char *listSSN = list_inspect_ssn(pos);
-					if (strncmp((char *)ssn, listSSN, SSN_LENGTH) == 0)
-					{
-						const char *name = list_inspect_name(pos);
-						const char *email = list_inspect_email(pos);
-						bytesWritten = writeLookupResponse(lookupResponse, ssn, (unsigned char *)name, (unsigned char *)email, netNode);
-
-						break;
-					}
-					pos = list_next(pos);
-				}
-			}
-
-			if (bytesWritten > 0)
-			{ //Send response
-				struct sockaddr_in senderAddr;
-				senderAddr.sin_family = AF_INET;
-				senderAddr.sin_addr.s_addr = htonl(lookupMessage.sender_address);
-				senderAddr.sin_port = htons(lookupMessage.sender_port);
-				socklen_t addrLen = sizeof(senderAddr);
-
-				if (sendto(netNode->fds[UDP_SOCKET_A].fd, lookupResponse, bytesWritten, 0, (struct sockaddr *)&senderAddr, addrLen) == -1)
-				{
-					exit_on_error("Could not send response to tracker", netNode);
-				}
-			}
+		else if (netNode->pduMessage[0] == VAL_LOOKUP)
+		{
 			messageSize = LOOKUP_SIZE;
 		}
+		deliverEntry(netNode, hash, netNode->pduMessage, messageSize);
 	}
 	else
 	{ //HASH(entry) NOT in node, forward message
 		char *choice;
 		if (netNode->pduMessage[0] == VAL_INSERT)
 		{
-			insertMessage = readValInsertMessage(netNode->pduMessage);
-			messageSize = 3 + SSN_LENGTH + insertMessage->name_length + insertMessage->email_length;
-
-			free(insertMessage->name);
-			free(insertMessage->email);
-			free(insertMessage);
-
 			choice = "val_insert";
 		}
 		else if (netNode->pduMessage[0] == VAL_REMOVE)
@@ -672,19 +791,40 @@ eSystemState gotoStateQ9(struct NetNode *netNode)
 			choice = "val_lookup";
 		}
 
-		printf("\tForwarding %s to successor\n", choice);
-		if (send(netNode->fds[TCP_SOCKET_B].fd, netNode->pduMessage, messageSize, 0) == -1)
+		//Go the shorter way around, lookups skip ahead if we know a node closer
+		//to the owner. Inserts and removes stay on TCP, which keeps them in order
+		bool clockwise = routeClockwise(netNode, hash);
+		const struct sockaddr_in *finger = netNode->pduMessage[0] == VAL_LOOKUP ? closestFinger(netNode, hash, clockwise) : NULL;
+		if (finger != NULL)
+		{
+			log_debug("\tForwarding %s to finger V4(%s:%d)\n", choice, inet_ntoa(finger->sin_addr), ntohs(finger->sin_port));
+			sendDatagram(netNode, UDP_SOCKET_A, netNode->pduMessage, messageSize, *finger, "Could not forward to finger");
+			netNode->hops.byFinger++;
+			PROBE3(val_forward, netNode->pduMessage[0], hash, PROBE_VIA_FINGER);
+		}
+		else if (clockwise)
+		{
+			log_debug("\tForwarding %s to successor\n", choice);
+			sendToSocket(netNode, TCP_SOCKET_B, netNode->pduMessage, messageSize);
+			netNode->hops.bySuccessor++;
+			PROBE3(val_forward, netNode->pduMessage[0], hash, PROBE_VIA_SUCCESSOR);
+		}
+		else
 		{
-			exit_on_error("Could not forward NET_INSERT to successor", netNode);
+			log_debug("\tForwarding %s to predecessor\n", choice);
+			sendToSocket(netNode, TCP_SOCKET_D, netNode->pduMessage, messageSize);
+			netNode->hops.byPredecessor++;
+			PROBE3(val_forward, netNode->pduMessage[0], hash, PROBE_VIA_PREDECESSOR);
 		}
 	}
 
-	removeMsgFromBuffer(netNode->pduMessage, messageSize);
+	consumeMessage(netNode);
 	return q9;
 }
 
 eSystemState gotoStateQ10(struct NetNode *netNode)
 {
+	netNode->alive = false;
 	return q10;
 }
 
@@ -698,19 +838,11 @@ eSystemState gotoStateQ11(struct NetNode *netNode)
 
 	if (netNode->nodeRange.min == 0)
 	{
-		if (send(netNode->fds[TCP_SOCKET_B].fd, newRangeMessage, messageSize, 0) == -1)
-		{
-			perror("Could not send to successor");
-			exit(1);
-		}
+		sendToSocket(netNode, TCP_SOCKET_B, newRangeMessage, messageSize);
 	}
 	else
 	{
-		if (send(netNode->fds[TCP_SOCKET_D].fd, newRangeMessage, messageSize, 0) == -1)
-		{
-			perror("Could not send to successor");
-			exit(1);
-		}
+		sendToSocket(netNode, TCP_SOCKET_D, newRangeMessage, messageSize);
 	}
 
 	return q11;
@@ -724,7 +856,7 @@ eSystemState gotoStateQ12(struct NetNode *netNode)
 	unsigned char range = netNode->nodeRange.max - netNode->nodeRange.min;
 	if (range > joinRequest.max_span)
 	{
-		printf("\tI am the node with the maximum span! (%d)\n", range);
+		log_info("\tI am the node with the maximum span! (%d)\n", range);
 		netNode->pduMessage[7] = range;
 		serializeUint32(&netNode->pduMessage[8], netNode->fdsAddr[TCP_SOCKET_C].sin_addr.s_addr);
 		serializeUint16(&netNode->pduMessage[12], netNode->fdsAddr[TCP_SOCKET_C].sin_port);
@@ -746,38 +878,20 @@ eSystemState gotoStateQ13(struct NetNode *netNode)
 	size_t messageCloseSize = sizeof(closeConnectionMessage);
 	closeConnectionMessage[0] = NET_CLOSE_CONNECTION;
 
-	printf("\tSending NET_CLOSE_CONNECTION to successor\n");
-	if (send(netNode->fds[TCP_SOCKET_B].fd, closeConnectionMessage, messageCloseSize, 0) == -1)
-	{
-		exit_on_error("Could not send NET_CLOSE_CONNECTION to successor", netNode);
-	}
+	log_info("\tSending NET_CLOSE_CONNECTION to successor\n");
+	sendToSocket(netNode, TCP_SOCKET_B, closeConnectionMessage, messageCloseSize);
 
 	//Close and reopen socket B
-	close(netNode->fds[TCP_SOCKET_B].fd);
-	netNode->fds[TCP_SOCKET_B].fd = socket(AF_INET, SOCK_STREAM, 0);
-	if (netNode->fds[TCP_SOCKET_B].fd == -1)
-	{
-		exit_on_error("Could not connect to new successor", netNode);
-	}
+	closeSocket(netNode, TCP_SOCKET_B);
 
 	//Connect to prospect
 	struct NET_JOIN_PDU joinRequest = readNetJoinMessage(netNode->pduMessage);
 	netNode->fdsAddr[TCP_SOCKET_B].sin_family = AF_INET;
 	netNode->fdsAddr[TCP_SOCKET_B].sin_addr.s_addr = htonl(joinRequest.src_address);
 	netNode->fdsAddr[TCP_SOCKET_B].sin_port = htons(joinRequest.src_port);
-	socklen_t addLenB = sizeof(netNode->fdsAddr[TCP_SOCKET_B]);
 
-	if (connect(netNode->fds[TCP_SOCKET_B].fd, (struct sockaddr *)&netNode->fdsAddr[TCP_SOCKET_B], addLenB) == -1)
-	{
-		exit_on_error("Could not connect to new successor", netNode);
-	}
-
-	printf("\tConnected to new successor V4(");
-	printAddress(netNode->fdsAddr[TCP_SOCKET_B]);
-	printf(")\n");
-	printf("\tConnected to new successor Ok(V4(");
-	printAddress(netNode->fdsAddr[TCP_SOCKET_B]);
-	printf("))\n");
+	log_info("\tConnecting to new successor V4(%s:%d)\n", inet_ntoa(netNode->fdsAddr[TCP_SOCKET_B].sin_addr), ntohs(netNode->fdsAddr[TCP_SOCKET_B].sin_port));
+	connectSocket(netNode, TCP_SOCKET_B);
 
 	unsigned char minP = netNode->nodeRange.min;
 	unsigned char maxP = netNode->nodeRange.max;
@@ -793,30 +907,25 @@ eSystemState gotoStateQ13(struct NetNode *netNode)
 	size_t messageJoinSize = sizeof(netJoinResponseMessage);
 	writeNetJoinResponse(netJoinResponseMessage, netNode, oldSuccessor, minS, maxS);
 
-	printf("\tOther hash-range is (%d,%d)\n", minS, maxS);
-	printf("\tNew hash-range is (%d,%d)\n", minP, maxP);
-	printf("\tSending join response\n");
+	log_info("\tOther hash-range is (%d,%d)\n", minS, maxS);
+	log_info("\tNew hash-range is (%d,%d)\n", minP, maxP);
+	log_info("\tSending join response\n");
 
-	if (send(netNode->fds[TCP_SOCKET_B].fd, netJoinResponseMessage, messageJoinSize, 0) == -1)
-	{
-		exit_on_error("Could not send NET_JOIN", netNode);
-	}
+	sendToSocket(netNode, TCP_SOCKET_B, netJoinResponseMessage, messageJoinSize);
 	transferUpperRange(netNode, minS, maxS);
+	announceRange(netNode);
 
-	removeMsgFromBuffer(netNode->pduMessage, JOIN_SIZE);
+	consumeMessage(netNode);
 	return q13;
 }
 
 eSystemState gotoStateQ14(struct NetNode *netNode)
 {
-	printf("\tForwarding to successor\n");
+	log_info("\tForwarding to successor\n");
 
-	if (send(netNode->fds[TCP_SOCKET_B].fd, netNode->pduMessage, JOIN_SIZE, 0) == -1)
-	{
-		exit_on_error("Could not forward message to successor", netNode);
-	}
+	sendToSocket(netNode, TCP_SOCKET_B, netNode->pduMessage, JOIN_SIZE);
 
-	removeMsgFromBuffer(netNode->pduMessage, JOIN_SIZE);
+	consumeMessage(netNode);
 	return q14;
 }
 
@@ -827,189 +936,168 @@ eSystemState gotoStateQ15(struct NetNode *netNode)
 	newRangeResponse[0] = NET_NEW_RANGE_RESPONSE;
 	size_t messageSize = sizeof(newRangeResponse);
 
-	printf("\tCurrent range is: (%d, %d)\n", netNode->nodeRange.min, netNode->nodeRange.max);
+	log_info("\tCurrent range is: (%d, %d)\n", netNode->nodeRange.min, netNode->nodeRange.max);
 
 	if (newRange.range_start < netNode->nodeRange.min)
 	{
-		printf("\tSending NET_NEW_RANGE_RESPONSE to predecessor\n");
+		log_info("\tSending NET_NEW_RANGE_RESPONSE to predecessor\n");
 
 		netNode->nodeRange.min = newRange.range_start;
-		if (send(netNode->fds[TCP_SOCKET_D].fd, newRangeResponse, messageSize, 0) == -1)
-		{
-			exit_on_error("Could not send NET_NEW_RANGE_RESPONSE to predecessor", netNode);
-		}
+		sendToSocket(netNode, TCP_SOCKET_D, newRangeResponse, messageSize);
 	}
 	else
 	{
-		printf("\tSending NET_NEW_RANGE_RESPONSE to successor\n");
+		log_info("\tSending NET_NEW_RANGE_RESPONSE to successor\n");
 
 		netNode->nodeRange.max = newRange.range_end;
-		if (send(netNode->fds[TCP_SOCKET_B].fd, newRangeResponse, messageSize, 0) == -1)
-		{
-			exit_on_error("Could not send NET_NEW_RANGE_RESPONSE to successor", netNode);
-		}
+		sendToSocket(netNode, TCP_SOCKET_B, newRangeResponse, messageSize);
 	}
-	printf("\tNew range is: (%d, %d)\n", netNode->nodeRange.min, netNode->nodeRange.max);
+	log_info("\tNew range is: (%d, %d)\n", netNode->nodeRange.min, netNode->nodeRange.max);
+	announceRange(netNode);
+	rebuildFilters(netNode);
 
-	removeMsgFromBuffer(netNode->pduMessage, NEW_RANGE_SIZE);
+	consumeMessage(netNode);
 	return q15;
 }
 
 eSystemState gotoStateQ16(struct NetNode *netNode)
 {
-	printf("\tRemote closed the connection Ok(V4(");
-	printAddress(netNode->fdsAddr[TCP_SOCKET_B]);
-	printf("))\n");
+	log_info("\tRemote closed the connection Ok(V4(%s:%d))\n", inet_ntoa(netNode->fdsAddr[TCP_SOCKET_B].sin_addr), ntohs(netNode->fdsAddr[TCP_SOCKET_B].sin_port));
+
+	struct NET_LEAVING_PDU leavingMessage = readNetLeavingMessage(netNode->pduMessage);
+	consumeMessage(netNode);
 
 	//Close and reopen socket to successor
-	shutdown(netNode->fds[TCP_SOCKET_B].fd, SHUT_WR);
-	close(netNode->fds[TCP_SOCKET_B].fd);
-	netNode->fds[TCP_SOCKET_B].fd = 0;
+	closeSocket(netNode, TCP_SOCKET_B);
 
-	struct NET_LEAVING_PDU leavingMessage = readNetLeavingMessage(netNode->pduMessage);
 	netNode->fdsAddr[TCP_SOCKET_B].sin_family = AF_INET;
 	netNode->fdsAddr[TCP_SOCKET_B].sin_addr.s_addr = htonl(leavingMessage.new_address);
 	netNode->fdsAddr[TCP_SOCKET_B].sin_port = htons(leavingMessage.new_port);
-	socklen_t addrLenB = sizeof(netNode->fdsAddr[TCP_SOCKET_B]);
 
 	if (netNode->nodeRange.min == 0 && netNode->nodeRange.max == 255)
 	{
-		printf("\tI am the last node\n");
+		log_info("\tI am the last node\n");
 	}
 	else
 	{
-		netNode->fds[TCP_SOCKET_B].fd = socket(AF_INET, SOCK_STREAM, 0);
-		if (netNode->fds[TCP_SOCKET_B].fd == -1)
-		{
-			exit_on_error("Could not open socket to successor", netNode);
-		}
-		if (connect(netNode->fds[TCP_SOCKET_B].fd, (struct sockaddr *)&netNode->fdsAddr[TCP_SOCKET_B], addrLenB) == -1)
-		{
-			exit_on_error("Could not connect to successor", netNode);
-		}
+		log_info("\tConnecting to new successor V4(%s:%d)\n", inet_ntoa(netNode->fdsAddr[TCP_SOCKET_B].sin_addr), ntohs(netNode->fdsAddr[TCP_SOCKET_B].sin_port));
+		connectSocket(netNode, TCP_SOCKET_B);
 
-		printf("\tConnected to new successor V4(");
-		printAddress(netNode->fdsAddr[TCP_SOCKET_B]);
-		printf(")\n");
+		//An announcement sent through the leaving node may not have made it
+		announceRange(netNode);
 	}
 
-	removeMsgFromBuffer(netNode->pduMessage, LEAVING_SIZE);
 	return q16;
 }
 
 eSystemState gotoStateQ17(struct NetNode *netNode)
 {
-	printf("\tDisconnecting from predecessor\n");
+	log_info("\tDisconnecting from predecessor\n");
 
-	shutdown(netNode->fds[TCP_SOCKET_D].fd, SHUT_WR);
-	close(netNode->fds[TCP_SOCKET_D].fd);
-	netNode->fds[TCP_SOCKET_D].fd = 0;
+	consumeMessage(netNode);
+	closeSocket(netNode, TCP_SOCKET_D);
 
 	if (!(netNode->nodeRange.min == 0 && netNode->nodeRange.max == 255))
 	{
 		//If predecessor is not successor
-		netNode->fds[TCP_SOCKET_D].fd = socket(AF_INET, SOCK_STREAM, 0);
-		if (netNode->fds[TCP_SOCKET_D].fd == -1)
-		{
-			exit_on_error("Could not open socket to predecessor", netNode);
-		}
-		printf("\tAwaiting new predecessor\n");
-
-		socklen_t addrLenD = sizeof(TCP_SOCKET_D);
-		netNode->fds[TCP_SOCKET_D].fd = accept(netNode->fds[TCP_SOCKET_C].fd, (struct sockaddr *)&netNode->fdsAddr[TCP_SOCKET_D], &addrLenD);
-
-		printf("\tAccepted new predecessor V4(");
-		printAddress(netNode->fdsAddr[TCP_SOCKET_D]);
-		printf(")\n");
+		log_info("\tAwaiting new predecessor\n");
+		acceptPredecessor(netNode);
 	}
 	else
 	{
-		printf("\tI am the last node\n");
+		log_info("\tI am the last node\n");
 	}
 
-	removeMsgFromBuffer(netNode->pduMessage, CLOSE_CON_SIZE);
 	return q17;
 }
 
 eSystemState gotoStateQ18(struct NetNode *netNode)
 {
-	if (!list_is_empty(netNode->entries))
-	{
-		ListPos pos = list_first(netNode->entries);
-		while (!list_pos_equal(pos, list_end(netNode->entries)))
-		{
-			const char *ssn = list_inspect_ssn(pos);
-			const char *name = list_inspect_name(pos);
-			const char *email = list_inspect_email(pos);
-
-			unsigned char nameLen = strlen(name);
-			unsigned char emailLen = strlen(email);
-
-			size_t messageSize = 3 + SSN_LENGTH + nameLen + emailLen;
-			unsigned char insertMessage[messageSize];
-			writeValInsertMessage(insertMessage, ssn, name, email);
-
-			if (send(netNode->fds[TCP_SOCKET_B].fd, insertMessage, messageSize, 0) == -1)
-			{
-				perror("Could not send to successor");
-				exit(1);
-			}
-			pos = list_next(pos);
-		}
-	}
-	list_destroy(netNode->entries);
-	netNode->entries = NULL;
+	transferUpperRange(netNode, netNode->nodeRange.min, netNode->nodeRange.max);
+	destroyStores(netNode);
 
 	unsigned char closeMessage[1] = {'\0'};
 	closeMessage[0] = NET_CLOSE_CONNECTION;
 	size_t messageSize = sizeof(closeMessage);
 
-	if (send(netNode->fds[TCP_SOCKET_B].fd, closeMessage, messageSize, 0) == -1)
-	{
-		perror("Could not send to successor");
-		exit(1);
-	}
+	sendToSocket(netNode, TCP_SOCKET_B, closeMessage, messageSize);
 
 	unsigned char leavingMessage[LEAVING_SIZE] = {'\0'};
 	messageSize = sizeof(leavingMessage);
 	writeNetLeavingMessage(leavingMessage, netNode->fdsAddr[TCP_SOCKET_B]);
 
-	if (send(netNode->fds[TCP_SOCKET_D].fd, leavingMessage, messageSize, 0) == -1)
-	{
-		perror("Could not send to predecessor");
-		exit(1);
-	}
-	printf("\tTransferring all entries to successor\n");
-	printf("\tSending NET_LEAVING to predecessor\n");
+	sendToSocket(netNode, TCP_SOCKET_D, leavingMessage, messageSize);
+	log_info("\tTransferring all entries to successor\n");
+	log_info("\tSending NET_LEAVING to predecessor\n");
 
-	removeMsgFromBuffer(netNode->pduMessage, NEW_RANGE_RES_SIZE);
+	consumeMessage(netNode);
 	return q18;
 }
 
 eSystemState exitState(struct NetNode *netNode)
 {
-	shutdown(netNode->fds[UDP_SOCKET_A].fd, SHUT_WR);
-	close(netNode->fds[UDP_SOCKET_A].fd);
-
-	shutdown(netNode->fds[TCP_SOCKET_B].fd, SHUT_WR);
-	close(netNode->fds[TCP_SOCKET_B].fd);
-
-	shutdown(netNode->fds[TCP_SOCKET_C].fd, SHUT_WR);
-	close(netNode->fds[TCP_SOCKET_C].fd);
-
-	shutdown(netNode->fds[TCP_SOCKET_D].fd, SHUT_WR);
-	close(netNode->fds[TCP_SOCKET_D].fd);
-
-	shutdown(netNode->fds[UDP_SOCKET_A2].fd, SHUT_WR);
-	close(netNode->fds[UDP_SOCKET_A2].fd);
+	for (int i = 0; i < NO_SOCKETS; i++)
+	{
+		if (netNode->fds[i].fd != 0 && netNode->tx[i])
+		{
+			closeSocket(netNode, i);
+		}
+	}
+	drainLingering(netNode);
 
-	if (netNode->entries)
+	for (int bucket = 0; bucket < HASH_BUCKETS; bucket++)
+	{
+		dropBucketExpiries(netNode, bucket);
+	}
+	destroyStores(netNode);
+	if (netNode->replyFd != 0)
+	{
+		close(netNode->replyFd);
+		netNode->replyFd = 0;
+	}
+	if (netNode->passPipe[0] != 0)
+	{
+		close(netNode->passPipe[0]);
+		close(netNode->passPipe[1]);
+		netNode->passPipe[0] = 0;
+		netNode->passPipe[1] = 0;
+	}
+	if (netNode->pduScratch)
+	{
+		free(netNode->pduScratch);
+		netNode->pduScratch = NULL;
+	}
+	free(netNode->udpScratch);
+	netNode->udpScratch = NULL;
+	free(netNode->responses);
+	netNode->responses = NULL;
+	free(netNode->stats);
+	netNode->stats = NULL;
+	for (int i = 0; i < NO_SOCKETS; i++)
+	{
+		if (netNode->rx[i])
+		{
+			ring_destroy(netNode->rx[i]);
+			netNode->rx[i] = NULL;
+		}
+		if (netNode->tx[i])
+		{
+			ring_destroy(netNode->tx[i]);
+			netNode->tx[i] = NULL;
+		}
+	}
+	for (int i = 0; i < LINGER_SOCKETS; i++)
 	{
-		list_destroy(netNode->entries);
+		if (netNode->lingering[i].tx)
+		{
+			ring_destroy(netNode->lingering[i].tx);
+			netNode->lingering[i].tx = NULL;
+		}
 	}
-	if (netNode->pduMessage)
+	if (netNode->loop)
 	{
-		free(netNode->pduMessage);
+		event_loop_destroy(netNode->loop);
+		netNode->loop = NULL;
 	}
 
 	return lastState;
@@ -1048,6 +1136,12 @@ static void initTCPSocketC(struct NetNode *netNode)
 	{
 		exit_on_error("getsockname error", netNode);
 	}
+
+	//Listen right away, a predecessor may connect as soon as it hears of us
+	if (listen(netNode->fds[TCP_SOCKET_C].fd, SOMAXCONN) == -1)
+	{
+		exit_on_error("Could not listen on open TCP socket", netNode);
+	}
 }
 
 static struct STUN_RESPONSE_PDU readStunResponse(unsigned char *message)
@@ -1104,21 +1198,36 @@ static struct NET_NEW_RANGE_PDU readNewRange(unsigned char *message)
 	return newRange;
 }
 
-static struct VAL_INSERT_PDU *readValInsertMessage(unsigned char *message)
+// Parse a VAL_INSERT in place, name and email point into the message.
+// Returns the size of the PDU, or 0 if it does not fit in size bytes
+static size_t readValInsertMessage(unsigned char *message, size_t size, struct VAL_INSERT_PDU *insertMessage)
 {
-	struct VAL_INSERT_PDU *insertMessage = malloc(sizeof(struct VAL_INSERT_PDU));
+	size_t offset = SSN_LENGTH + 2;
+	if (size < offset)
+	{
+		return 0;
+	}
+
 	insertMessage->type = message[0];
 	memcpy(insertMessage->ssn, &message[1], SSN_LENGTH);
 
 	insertMessage->name_length = message[SSN_LENGTH + 1];
-	insertMessage->name = malloc(sizeof(unsigned char) * insertMessage->name_length);
-	memcpy(insertMessage->name, &message[SSN_LENGTH + 2], insertMessage->name_length);
+	insertMessage->name = &message[offset];
+	offset += insertMessage->name_length + 1;
+	if (size < offset)
+	{
+		return 0;
+	}
 
-	insertMessage->email_length = message[SSN_LENGTH + 2 + insertMessage->name_length];
-	insertMessage->email = malloc(sizeof(unsigned char) * insertMessage->email_length);
-	memcpy(insertMessage->email, &message[SSN_LENGTH + 3 + insertMessage->name_length], insertMessage->email_length);
+	insertMessage->email_length = message[offset - 1];
+	insertMessage->email = &message[offset];
+	offset += insertMessage->email_length;
+	if (size < offset)
+	{
+		return 0;
+	}
 
-	return insertMessage;
+	return offset;
 }
 
 static struct VAL_LOOKUP_PDU readLookupMessage(unsigned char *message)
@@ -1132,11 +1241,24 @@ static struct VAL_LOOKUP_PDU readLookupMessage(unsigned char *message)
 	return lookupMessage;
 }
 
-static struct NET_LEAVING_PDU readNetLeavingMessage(unsigned char *message)
+// "ssns" points into message
+static struct VAL_LOOKUP_MULTI_PDU readLookupMultiMessage(unsigned char *message)
 {
-	struct NET_LEAVING_PDU leavingMessage;
-	leavingMessage.type = message[0];
-	leavingMessage.new_address = deserializeUint32(&message[1]);
+	struct VAL_LOOKUP_MULTI_PDU lookupMessage;
+	lookupMessage.type = message[0];
+	lookupMessage.sender_address = deserializeUint32(&message[1]);
+	lookupMessage.sender_port = deserializeUint16(&message[5]);
+	lookupMessage.count = deserializeUint16(&message[7]);
+	lookupMessage.ssns = &message[LOOKUP_MULTI_HEADER_SIZE];
+
+	return lookupMessage;
+}
+
+static struct NET_LEAVING_PDU readNetLeavingMessage(unsigned char *message)
+{
+	struct NET_LEAVING_PDU leavingMessage;
+	leavingMessage.type = message[0];
+	leavingMessage.new_address = deserializeUint32(&message[1]);
 	leavingMessage.new_port = deserializeUint16(&message[5]);
 
 	return leavingMessage;
@@ -1162,7 +1284,7 @@ static void writeNetJoinResponse(unsigned char *destMessage, struct NetNode *net
 	destMessage[8] = maxS;
 }
 
-static int writeLookupResponse(unsigned char *destMessage, unsigned char *ssn, unsigned char *name, unsigned char *email, struct NetNode *netNode)
+static int writeLookupResponse(unsigned char *destMessage, unsigned char *ssn, unsigned char *name, unsigned char *email)
 {
 	int nameLen = strlen((char *)name);
 	int emailLen = strlen((char *)email);
@@ -1190,6 +1312,29 @@ static void writeValInsertMessage(unsigned char *message, const char *ssn, const
 	memcpy(&message[3 + SSN_LENGTH + nameLen], (unsigned char *)email, emailLen);
 }
 
+static void writeRangeUpdate(unsigned char *message, Range range, struct sockaddr_in addr, uint8_t hopsLeft)
+{
+	message[0] = NET_RANGE_UPDATE;
+	message[1] = range.min;
+	message[2] = range.max;
+	serializeUint32(&message[3], addr.sin_addr.s_addr);
+	serializeUint16(&message[7], addr.sin_port);
+	message[9] = hopsLeft;
+}
+
+static struct NET_RANGE_UPDATE_PDU readRangeUpdate(unsigned char *message)
+{
+	struct NET_RANGE_UPDATE_PDU rangeUpdate;
+	rangeUpdate.type = message[0];
+	rangeUpdate.range_start = message[1];
+	rangeUpdate.range_end = message[2];
+	rangeUpdate.address = deserializeUint32(&message[3]);
+	rangeUpdate.port = deserializeUint16(&message[7]);
+	rangeUpdate.hops_left = message[9];
+
+	return rangeUpdate;
+}
+
 static void writeNetLeavingMessage(unsigned char *message, struct sockaddr_in addr)
 {
 	message[0] = NET_LEAVING;
@@ -1209,87 +1354,2066 @@ static void writeArgvMessage(unsigned char *message, char *addr, char *port)
 
 static void transferUpperRange(struct NetNode *netNode, uint8_t minS, uint8_t maxS)
 {
-	if (!list_is_empty(netNode->entries))
+	struct InsertBatch batch;
+	batch.count = 0;
+	size_t bytes = 0;
+
+	//The workers must not touch their stores while buckets are detached
+	quiesceShards(netNode);
+	size_t entries = entryCount(netNode);
+
+	for (int bucket = minS; bucket <= maxS; bucket++)
+	{
+		bytes += transferBucket(netNode, bucket, &batch);
+	}
+	batchFlush(netNode, &batch);
+	rebuildFilters(netNode);
+	PROBE4(transfer_range, minS, maxS, entries - entryCount(netNode), bytes);
+}
+
+// Detach a whole bucket from the store and add its entries to a batch for
+// the successor. Returns the bytes of VAL_INSERT added
+static size_t transferBucket(struct NetNode *netNode, hash_t bucket, struct InsertBatch *batch)
+{
+	size_t bytes = 0;
+	Table *tbl = store_detach(storeOf(netNode, bucket), bucket);
+	if (tbl == NULL)
+	{
+		return 0;
+	}
+	//The new owner starts the TTL over when it stores the entries
+	dropBucketExpiries(netNode, bucket);
+
+	TablePos pos = table_first(tbl);
+	while (!table_pos_equal(pos, table_end(tbl)))
+	{
+		const char *ssn = table_inspect_ssn(pos);
+		const char *name = table_inspect_name(pos);
+		const char *email = table_inspect_email(pos);
+		size_t messageSize = 3 + SSN_LENGTH + strlen(name) + strlen(email);
+		unsigned char insertMessage[messageSize];
+		writeValInsertMessage(insertMessage, ssn, name, email);
+
+		batchAppend(netNode, batch, insertMessage, messageSize);
+		bytes += messageSize;
+		pos = table_next(pos);
+	}
+	table_destroy(tbl);
+	return bytes;
+}
+
+// Store a parsed VAL_INSERT. name and email must have room for the name and
+// email plus a terminating NUL, they are filled in for the caller
+static void insertEntry(Store *store, struct VAL_INSERT_PDU *insertMessage, char *name, char *email)
+{
+	char ssn[SSN_LENGTH + 1];
+	memcpy(ssn, insertMessage->ssn, SSN_LENGTH);
+	ssn[SSN_LENGTH] = '\0';
+
+	memcpy(name, insertMessage->name, insertMessage->name_length);
+	memcpy(email, insertMessage->email, insertMessage->email_length);
+	name[insertMessage->name_length] = '\0';
+	email[insertMessage->email_length] = '\0';
+
+	store_insert(store, ssn, email, name);
+}
+
+// Handle a VAL_INSERT, VAL_REMOVE or VAL_LOOKUP for a hash in our range, on
+// this thread or on the worker that owns the hash. Entry TTLs are kept here
+static void deliverEntry(struct NetNode *netNode, hash_t hash, unsigned char *message, size_t size)
+{
+	if (message[0] == VAL_INSERT && netNode->config.entryTtl > 0)
 	{
-		ListPos pos = list_first(netNode->entries);
-		while (!list_pos_equal(pos, list_end(netNode->entries)))
+		char ssn[SSN_LENGTH + 1] = {'\0'};
+		memcpy(ssn, &message[1], SSN_LENGTH);
+		armExpiry(netNode, ssn);
+	}
+	else if (message[0] == VAL_REMOVE)
+	{
+		struct EntryExpiry **expiry = findExpiry(netNode, (char *)&message[1]);
+		if (expiry != NULL)
 		{
-			const char *ssn = list_inspect_ssn(pos);
-			hash_t hash = hash_ssn((char *)ssn);
-			if (hash >= minS && hash <= maxS)
-			{
-				const char *name = list_inspect_name(pos);
-				const char *email = list_inspect_email(pos);
-				int nameLen = strlen(name);
-				int emailLen = strlen(email);
-				size_t messageSize = 3 + SSN_LENGTH + nameLen + emailLen;
-				unsigned char insertMessage[messageSize];
-				writeValInsertMessage(insertMessage, ssn, name, email);
-
-				if (send(netNode->fds[TCP_SOCKET_B].fd, insertMessage, messageSize, 0) == -1)
-				{
-					exit_on_error("Could not send to successor", netNode);
-				}
-				pos = list_remove(pos);
-			}
-			else
+			dropExpiry(netNode, *expiry);
+		}
+	}
+
+	if (netNode->config.workers > 0)
+	{
+		postToShard(netNode, &netNode->shards[hash % netNode->config.workers], message, size);
+		return;
+	}
+
+	unsigned char response[RESPONSE_SIZE];
+	struct sockaddr_in responseAddr;
+	int responseSize = applyEntry(netNode->entries, message, size, response, &responseAddr);
+	if (responseSize > 0)
+	{
+		queueResponse(netNode, response, responseSize, responseAddr, message[0] == VAL_LOOKUP_MULTI);
+	}
+}
+
+// Apply a VAL_INSERT, VAL_REMOVE, VAL_LOOKUP or VAL_LOOKUP_MULTI of one ssn
+// to a store. Returns the size of the VAL_LOOKUP_RESPONSE written to
+// response, 0 if there is none
+static int applyEntry(Store *store, unsigned char *message, size_t size, unsigned char *response, struct sockaddr_in *responseAddr)
+{
+	unsigned char ssn[SSN_LENGTH + 1] = {'\0'};
+	memcpy(ssn, message[0] == VAL_LOOKUP_MULTI ? &message[LOOKUP_MULTI_HEADER_SIZE] : &message[1], SSN_LENGTH);
+
+	if (message[0] == VAL_INSERT)
+	{
+		struct VAL_INSERT_PDU insertMessage;
+		readValInsertMessage(message, size, &insertMessage);
+		char name[insertMessage.name_length + 1];
+		char email[insertMessage.email_length + 1];
+
+		insertEntry(store, &insertMessage, name, email);
+		log_debug("\tInserting ssn Entry { ssn: \"%s\", name: \"%s\", email: \"%s\" }\n", ssn, name, email);
+	}
+	else if (message[0] == VAL_REMOVE)
+	{
+		//Remove ssn if found
+		if (store_erase(store, (char *)ssn))
+		{
+			log_debug("Removing ssn %s\n", ssn);
+		}
+	}
+	else
+	{ //Do lookup, answer misses too so the client need not time out
+		struct VAL_LOOKUP_PDU lookupMessage = readLookupMessage(message);
+		if (message[0] == VAL_LOOKUP_MULTI)
+		{
+			struct VAL_LOOKUP_MULTI_PDU multiMessage = readLookupMultiMessage(message);
+			lookupMessage.sender_address = multiMessage.sender_address;
+			lookupMessage.sender_port = multiMessage.sender_port;
+		}
+		memset(responseAddr, 0, sizeof(*responseAddr));
+		responseAddr->sin_family = AF_INET;
+		responseAddr->sin_addr.s_addr = htonl(lookupMessage.sender_address);
+		responseAddr->sin_port = htons(lookupMessage.sender_port);
+
+		TablePos pos;
+		if (store_find(store, (char *)ssn, &pos))
+		{
+			const char *name = table_inspect_name(pos);
+			const char *email = table_inspect_email(pos);
+			return writeLookupResponse(response, ssn, (unsigned char *)name, (unsigned char *)email);
+		}
+
+		//Not found is an empty name and email
+		log_debug("Lookup of ssn %s found nothing\n", ssn);
+		return writeLookupResponse(response, ssn, (unsigned char *)"", (unsigned char *)"");
+	}
+
+	return 0;
+}
+
+// Without workers there is one store, with them one per worker
+static void createStores(struct NetNode *netNode)
+{
+	if (netNode->config.workers == 0)
+	{
+		netNode->entries = store_create();
+		return;
+	}
+
+	for (int i = 0; i < netNode->config.workers; i++)
+	{
+		struct Shard *shard = &netNode->shards[i];
+		shard->entries = store_create();
+		countShard(shard);
+		shard->worker = worker_create(handleShardMessage, shard, WORKER_SLOTS, WORKER_SLOT_SIZE, netNode->replyFd);
+		if (shard->worker == NULL)
+		{
+			exit_on_error("Could not start worker", netNode);
+		}
+	}
+	log_info("\tEntries are kept by %d workers\n", netNode->config.workers);
+}
+
+// Stop the workers, after they handled what was posted, and free the stores
+static void destroyStores(struct NetNode *netNode)
+{
+	//Posts that wait for room in an inbox go first
+	quiesceShards(netNode);
+	if (netNode->entries)
+	{
+		store_destroy(netNode->entries);
+		netNode->entries = NULL;
+	}
+
+	for (int i = 0; i < netNode->config.workers; i++)
+	{
+		struct Shard *shard = &netNode->shards[i];
+		if (shard->worker)
+		{
+			worker_destroy(shard->worker);
+			shard->worker = NULL;
+		}
+		if (shard->entries)
+		{
+			store_destroy(shard->entries);
+			shard->entries = NULL;
+		}
+	}
+}
+
+// Size the Bloom filters of the stores for the entries they hold now, after
+// the range changed. Waits for the workers to finish what was posted
+static void rebuildFilters(struct NetNode *netNode)
+{
+	if (netNode->entries)
+	{
+		store_rebuild_filter(netNode->entries);
+	}
+
+	quiesceShards(netNode);
+	for (int i = 0; i < netNode->config.workers; i++)
+	{
+		struct Shard *shard = &netNode->shards[i];
+		if (shard->entries)
+		{
+			store_rebuild_filter(shard->entries);
+			countShard(shard);
+		}
+	}
+}
+
+// The store holding the hash. With workers, only while its worker is idle
+static Store *storeOf(struct NetNode *netNode, hash_t hash)
+{
+	if (netNode->config.workers == 0)
+	{
+		return netNode->entries;
+	}
+	return netNode->shards[hash % netNode->config.workers].entries;
+}
+
+static size_t entryCount(struct NetNode *netNode)
+{
+	if (netNode->config.workers == 0)
+	{
+		return netNode->entries ? store_get_length(netNode->entries) : 0;
+	}
+
+	size_t length = 0;
+	for (int i = 0; i < netNode->config.workers; i++)
+	{
+		length += atomic_load_explicit(&netNode->shards[i].length, memory_order_relaxed);
+	}
+	return length;
+}
+
+static size_t entryMemory(struct NetNode *netNode)
+{
+	if (netNode->config.workers == 0)
+	{
+		return netNode->entries ? store_memory_usage(netNode->entries) : 0;
+	}
+
+	size_t memory = 0;
+	for (int i = 0; i < netNode->config.workers; i++)
+	{
+		memory += atomic_load_explicit(&netNode->shards[i].memory, memory_order_relaxed);
+	}
+	return memory;
+}
+
+// Runs on the worker of a shard, lookup responses are sent by the I/O thread.
+// A reply is the address, whether to gather it, and the response
+static void handleShardMessage(Worker *worker, void *message, size_t size, void *context)
+{
+	struct Shard *shard = context;
+	unsigned char reply[WORKER_SLOT_SIZE];
+	struct sockaddr_in responseAddr;
+
+	int responseSize = applyEntry(shard->entries, message, size, &reply[sizeof(responseAddr) + 1], &responseAddr);
+	if (responseSize > 0)
+	{
+		memcpy(reply, &responseAddr, sizeof(responseAddr));
+		reply[sizeof(responseAddr)] = ((unsigned char *)message)[0] == VAL_LOOKUP_MULTI;
+		if (!worker_reply(worker, reply, sizeof(responseAddr) + 1 + responseSize))
+		{
+			log_warn("Worker replies are not taken, dropping a lookup response\n");
+		}
+	}
+	countShard(shard);
+}
+
+// Publish the size of a store, by the thread that owns it right now
+static void countShard(struct Shard *shard)
+{
+	atomic_store_explicit(&shard->length, store_get_length(shard->entries), memory_order_relaxed);
+	atomic_store_explicit(&shard->memory, store_memory_usage(shard->entries), memory_order_relaxed);
+}
+
+// Post a copy of a message to the worker of a shard. What its inbox has no
+// room for waits on the shard, the worker signals replies once it has room
+static void postToShard(struct NetNode *netNode, struct Shard *shard, const unsigned char *message, size_t size)
+{
+	if (shard->pending == NULL && worker_post(shard->worker, message, size))
+	{
+		takeShardReplies(netNode, shard);
+		return;
+	}
+
+	struct PendingPost *post = malloc(sizeof(struct PendingPost) + size);
+	if (post == NULL)
+	{
+		exit_on_error("Malloc error", netNode);
+	}
+	post->next = NULL;
+	post->size = size;
+	memcpy(post->message, message, size);
+	if (shard->pending == NULL)
+	{
+		shard->pendingTail = &shard->pending;
+	}
+	*shard->pendingTail = post;
+	shard->pendingTail = &post->next;
+}
+
+// Post what waits on a shard, as far as the inbox has room
+static void postPending(struct Shard *shard)
+{
+	while (shard->pending != NULL && worker_post(shard->worker, shard->pending->message, shard->pending->size))
+	{
+		struct PendingPost *post = shard->pending;
+		shard->pending = post->next;
+		free(post);
+	}
+}
+
+// Queue the lookup responses of a worker, they are sent like our own, and
+// post what waits for room in its inbox
+static void takeShardReplies(struct NetNode *netNode, struct Shard *shard)
+{
+	size_t size;
+	unsigned char *reply;
+	postPending(shard);
+	while ((reply = worker_reply_front(shard->worker, &size)) != NULL)
+	{
+		struct sockaddr_in addr;
+		memcpy(&addr, reply, sizeof(addr));
+		queueResponse(netNode, reply + sizeof(addr) + 1, size - sizeof(addr) - 1, addr, reply[sizeof(addr)]);
+		worker_reply_pop(shard->worker);
+	}
+}
+
+static void takeReplies(struct NetNode *netNode)
+{
+	for (int i = 0; i < netNode->config.workers; i++)
+	{
+		if (netNode->shards[i].worker)
+		{
+			takeShardReplies(netNode, &netNode->shards[i]);
+		}
+	}
+}
+
+// Wait until every worker has handled what was posted, the stores can then
+// be used from this thread until the next post. Replies are taken while we
+// wait, so the workers never drop one
+static void quiesceShards(struct NetNode *netNode)
+{
+	for (int i = 0; i < netNode->config.workers; i++)
+	{
+		struct Shard *shard = &netNode->shards[i];
+		while (shard->worker && (shard->pending != NULL || !worker_idle(shard->worker)))
+		{
+			takeShardReplies(netNode, shard);
+			worker_notify(shard->worker);
+			if (shard->pending != NULL || !worker_idle(shard->worker))
 			{
-				pos = list_next(pos);
+				waitReplies(netNode);
 			}
 		}
 	}
 }
 
-void sig_handler(int signum)
+// Sleep until a worker writes to the reply descriptor
+static void waitReplies(struct NetNode *netNode)
 {
-	if (signum == 2)
+	struct pollfd pollFd = {.fd = netNode->replyFd, .events = POLLIN};
+	uint64_t signals;
+
+	if (poll(&pollFd, 1, -1) == -1 && errno != EINTR)
+	{
+		exit_on_error("Could not wait for workers", netNode);
+	}
+	while (read(netNode->replyFd, &signals, sizeof(signals)) == -1 && errno == EINTR)
 	{
-		printf("\tClose requested!\n");
 	}
 }
 
-static uint32_t deserializeUint32(unsigned char *message)
+// The expiry of an entry, as the link that points to it, or NULL
+static struct EntryExpiry **findExpiry(struct NetNode *netNode, const char *ssn)
 {
-	uint32_t value = 0;
+	struct EntryExpiry **link = &netNode->expiries[hash_ssn((char *)ssn)];
+	while (*link != NULL)
+	{
+		if (memcmp((*link)->ssn, ssn, SSN_LENGTH) == 0)
+		{
+			return link;
+		}
+		link = &(*link)->next;
+	}
 
-	value |= message[0] << 24;
-	value |= message[1] << 16;
-	value |= message[2] << 8;
-	value |= message[3];
+	return NULL;
+}
 
-	return value;
+// Start the TTL of an entry over, adding an expiry the first time
+static void armExpiry(struct NetNode *netNode, const char *ssn)
+{
+	struct EntryExpiry *expiry;
+	struct EntryExpiry **link = findExpiry(netNode, ssn);
+	if (link != NULL)
+	{
+		expiry = *link;
+	}
+	else
+	{
+		expiry = malloc(sizeof(struct EntryExpiry));
+		if (expiry == NULL)
+		{
+			exit_on_error("Malloc error", netNode);
+		}
+		event_timer_init(&expiry->timer);
+		memcpy(expiry->ssn, ssn, SSN_LENGTH + 1);
+
+		struct EntryExpiry **head = &netNode->expiries[hash_ssn((char *)ssn)];
+		expiry->prev = NULL;
+		expiry->next = *head;
+		if (*head != NULL)
+		{
+			(*head)->prev = expiry;
+		}
+		*head = expiry;
+	}
+
+	event_timer_start(netNode->loop, &expiry->timer, TIMER_EXPIRY, netNode->config.entryTtl, 0);
 }
 
-static uint16_t deserializeUint16(unsigned char *message)
+static void dropExpiry(struct NetNode *netNode, struct EntryExpiry *expiry)
 {
-	uint16_t value = 0;
+	if (netNode->loop)
+	{
+		event_timer_stop(netNode->loop, &expiry->timer);
+	}
 
-	value |= message[0] << 8;
-	value |= message[1];
+	if (expiry->prev != NULL)
+	{
+		expiry->prev->next = expiry->next;
+	}
+	else
+	{
+		netNode->expiries[hash_ssn(expiry->ssn)] = expiry->next;
+	}
+	if (expiry->next != NULL)
+	{
+		expiry->next->prev = expiry->prev;
+	}
+	free(expiry);
+}
 
-	return value;
+static void dropBucketExpiries(struct NetNode *netNode, hash_t bucket)
+{
+	while (netNode->expiries[bucket] != NULL)
+	{
+		dropExpiry(netNode, netNode->expiries[bucket]);
+	}
 }
 
-static void serializeUint16(unsigned char *message, uint16_t value)
+static void expireEntry(struct NetNode *netNode, struct EntryExpiry *expiry)
 {
-	memcpy(message, &value, 2);
+	unsigned char removeMessage[REMOVE_SIZE];
+	removeMessage[0] = VAL_REMOVE;
+	memcpy(&removeMessage[1], expiry->ssn, SSN_LENGTH);
+	hash_t hash = hash_ssn(expiry->ssn);
+	log_debug("\tEntry %s expired\n", expiry->ssn);
+
+	dropExpiry(netNode, expiry);
+	deliverEntry(netNode, hash, removeMessage, REMOVE_SIZE);
 }
 
-static void serializeUint32(unsigned char *message, uint32_t value)
+// Store the records of a VAL_INSERT_BATCH that are in our range and forward
+// the others to the successor, regrouped into as few batches as possible
+static void insertBatch(struct NetNode *netNode)
 {
-	memcpy(message, &value, 4);
+	unsigned char *message = netNode->pduMessage;
+	uint16_t count = deserializeUint16(&message[1]);
+	size_t end = BATCH_HEADER_SIZE + deserializeUint16(&message[3]);
+	size_t offset = BATCH_HEADER_SIZE;
+	int stored = 0;
+
+	struct InsertBatch forward;
+	forward.count = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		struct VAL_INSERT_PDU insertMessage;
+		size_t recordSize = 0;
+		if (offset < end && message[offset] == VAL_INSERT)
+		{
+			recordSize = readValInsertMessage(&message[offset], end - offset, &insertMessage);
+		}
+		if (recordSize == 0)
+		{
+			log_warn("Malformed VAL_INSERT_BATCH, dropping %d of %d records\n", count - i, count);
+			break;
+		}
+
+		char ssn[SSN_LENGTH + 1];
+		memcpy(ssn, insertMessage.ssn, SSN_LENGTH);
+		ssn[SSN_LENGTH] = '\0';
+		hash_t hash = hash_ssn(ssn);
+
+		if (hash >= netNode->nodeRange.min && hash <= netNode->nodeRange.max)
+		{
+			deliverEntry(netNode, hash, &message[offset], recordSize);
+			stored++;
+			PROBE2(val_store, VAL_INSERT, hash);
+		}
+		else
+		{
+			batchAppend(netNode, &forward, &message[offset], recordSize);
+			PROBE3(val_forward, VAL_INSERT, hash, PROBE_VIA_SUCCESSOR);
+		}
+		offset += recordSize;
+	}
+
+	int forwarded = forward.count;
+	batchFlush(netNode, &forward);
+	log_debug("\tInserted %d entries from VAL_INSERT_BATCH, forwarded %d to successor\n", stored, forwarded);
+}
+
+// Answer the ssns of a VAL_LOOKUP_MULTI that are in our range and forward
+// the others to the successor, in one VAL_LOOKUP_MULTI
+static void lookupMulti(struct NetNode *netNode)
+{
+	unsigned char *message = netNode->pduMessage;
+	struct VAL_LOOKUP_MULTI_PDU lookupMessage = readLookupMultiMessage(message);
+	unsigned char forward[BATCH_SIZE];
+	size_t forwardSize = LOOKUP_MULTI_HEADER_SIZE;
+	int answered = 0;
+
+	//Each ssn is delivered as a VAL_LOOKUP_MULTI of its own, so it finds its
+	//worker and the answers are gathered into datagrams to the sender
+	unsigned char lookup[LOOKUP_MULTI_HEADER_SIZE + SSN_LENGTH];
+	memcpy(lookup, message, LOOKUP_MULTI_HEADER_SIZE);
+	serializeUint16(&lookup[7], htons(1));
+
+	for (int i = 0; i < lookupMessage.count; i++)
+	{
+		unsigned char *record = &lookupMessage.ssns[i * SSN_LENGTH];
+		char ssn[SSN_LENGTH + 1] = {'\0'};
+		memcpy(ssn, record, SSN_LENGTH);
+		hash_t hash = hash_ssn(ssn);
+
+		if (hash >= netNode->nodeRange.min && hash <= netNode->nodeRange.max)
+		{
+			memcpy(&lookup[LOOKUP_MULTI_HEADER_SIZE], record, SSN_LENGTH);
+			netNode->hops.delivered++;
+			PROBE2(val_store, VAL_LOOKUP_MULTI, hash);
+			deliverEntry(netNode, hash, lookup, sizeof(lookup));
+			answered++;
+		}
+		else
+		{
+			memcpy(&forward[forwardSize], record, SSN_LENGTH);
+			forwardSize += SSN_LENGTH;
+			PROBE3(val_forward, VAL_LOOKUP_MULTI, hash, PROBE_VIA_SUCCESSOR);
+		}
+	}
+
+	int forwarded = (forwardSize - LOOKUP_MULTI_HEADER_SIZE) / SSN_LENGTH;
+	if (forwarded > 0)
+	{
+		memcpy(forward, message, LOOKUP_MULTI_HEADER_SIZE);
+		//serializeUint16 copies as is, the fields are sent in network order
+		serializeUint16(&forward[7], htons(forwarded));
+		sendToSocket(netNode, TCP_SOCKET_B, forward, forwardSize);
+		netNode->hops.bySuccessor++;
+	}
+	log_debug("\tAnswered %d ssns from VAL_LOOKUP_MULTI, forwarded %d to successor\n", answered, forwarded);
 }
 
-static void removeMsgFromBuffer(unsigned char *buffer, int size)
+// Add a VAL_INSERT to a batch, sending the batch first if it is full
+static void batchAppend(struct NetNode *netNode, struct InsertBatch *batch, const unsigned char *record, size_t recordSize)
 {
-	unsigned char temp[BUFF_SIZE - size];
-	memcpy(temp, &buffer[size], BUFF_SIZE - size);
-	memcpy(buffer, temp, BUFF_SIZE - size);
+	if (batch->count > 0 && (batch->size + recordSize > BATCH_SIZE || batch->count == UINT16_MAX))
+	{
+		batchFlush(netNode, batch);
+	}
+	if (batch->count == 0)
+	{
+		batch->size = BATCH_HEADER_SIZE;
+	}
+
+	memcpy(&batch->message[batch->size], record, recordSize);
+	batch->size += recordSize;
+	batch->count++;
+}
+
+// Send a batch to the successor as one VAL_INSERT_BATCH and empty it
+static void batchFlush(struct NetNode *netNode, struct InsertBatch *batch)
+{
+	if (batch->count == 0)
+	{
+		return;
+	}
+
+	batch->message[0] = VAL_INSERT_BATCH;
+	//serializeUint16 copies as is, the fields are sent in network order
+	serializeUint16(&batch->message[1], htons(batch->count));
+	serializeUint16(&batch->message[3], htons(batch->size - BATCH_HEADER_SIZE));
+	sendToSocket(netNode, TCP_SOCKET_B, batch->message, batch->size);
+	batch->count = 0;
+}
+
+void sig_handler(int signum)
+{
+	if (signum == 2)
+	{
+		//Not through the log, the handler may interrupt a log_write
+		const char message[] = "\tClose requested!\n";
+		ssize_t unused = write(STDOUT_FILENO, message, sizeof(message) - 1);
+		(void)unused;
+	}
+}
+
+static uint32_t deserializeUint32(unsigned char *message)
+{
+	uint32_t value = 0;
+
+	value |= message[0] << 24;
+	value |= message[1] << 16;
+	value |= message[2] << 8;
+	value |= message[3];
+
+	return value;
+}
+
+static uint16_t deserializeUint16(unsigned char *message)
+{
+	uint16_t value = 0;
+
+	value |= message[0] << 8;
+	value |= message[1];
+
+	return value;
+}
+
+static void serializeUint16(unsigned char *message, uint16_t value)
+{
+	memcpy(message, &value, 2);
+}
+
+static void serializeUint32(unsigned char *message, uint32_t value)
+{
+	memcpy(message, &value, 4);
+}
+
+static void serializeUint64(unsigned char *message, uint64_t value)
+{
+	memcpy(message, &value, 8);
+}
+
+// Size of the message at offset in the ring, 0 if it is not complete yet
+// and -1 if the message type is unknown
+static ssize_t frameSize(const Ring *ring, size_t offset)
+{
+	size_t available = ring_length(ring) - offset;
+	size_t size;
+
+	if (available == 0)
+	{
+		return 0;
+	}
+
+	switch (ring_at(ring, offset))
+	{
+	case STUN_RESPONSE:
+		size = STUN_RESP_SIZE;
+		break;
+	case NET_GET_NODE_RESPONSE:
+		size = GET_NODE_RESP_SIZE;
+		break;
+	case NET_JOIN:
+		size = JOIN_SIZE;
+		break;
+	case NET_JOIN_RESPONSE:
+		size = JOIN_RESP_SIZE;
+		break;
+	case NET_CLOSE_CONNECTION:
+		size = CLOSE_CON_SIZE;
+		break;
+	case NET_NEW_RANGE:
+		size = NEW_RANGE_SIZE;
+		break;
+	case NET_LEAVING:
+		size = LEAVING_SIZE;
+		break;
+	case NET_NEW_RANGE_RESPONSE:
+		size = NEW_RANGE_RES_SIZE;
+		break;
+	case NET_RANGE_UPDATE:
+		size = RANGE_UPDATE_SIZE;
+		break;
+	case NET_GET_RANGE_MAP:
+		size = GET_RANGE_MAP_SIZE;
+		break;
+	case NET_GET_STATS:
+		size = GET_STATS_SIZE;
+		break;
+	case VAL_REMOVE:
+		size = REMOVE_SIZE;
+		break;
+	case VAL_LOOKUP:
+		size = LOOKUP_SIZE;
+		break;
+	case VAL_INSERT_BATCH:
+		//type, count, length, records
+		if (available < BATCH_HEADER_SIZE)
+		{
+			return 0;
+		}
+		size = BATCH_HEADER_SIZE + (ring_at(ring, offset + 3) << 8 | ring_at(ring, offset + 4));
+		if (size > BATCH_SIZE)
+		{
+			return -1;
+		}
+		break;
+	case VAL_LOOKUP_MULTI:
+		//type, sender address, sender port, count, ssns
+		if (available < LOOKUP_MULTI_HEADER_SIZE)
+		{
+			return 0;
+		}
+		size = LOOKUP_MULTI_HEADER_SIZE + (ring_at(ring, offset + 7) << 8 | ring_at(ring, offset + 8)) * SSN_LENGTH;
+		if (size > BATCH_SIZE)
+		{
+			return -1;
+		}
+		break;
+	case VAL_INSERT:
+		//type, ssn, name length, name, email length, email
+		if (available < SSN_LENGTH + 2)
+		{
+			return 0;
+		}
+		size = SSN_LENGTH + 2 + ring_at(ring, offset + SSN_LENGTH + 1);
+		if (available < size + 1)
+		{
+			return 0;
+		}
+		size += 1 + ring_at(ring, offset + size);
+		break;
+	default:
+		return -1;
+	}
+
+	return available < size ? 0 : (ssize_t)size;
+}
+
+// Make the next complete message in the receive rings the current message.
+// Sockets take turns, each handling up to socketBudget messages before the
+// next socket with a complete message is served
+static bool nextMessage(struct NetNode *netNode)
+{
+	//One extra step so the current socket is served again if it is the only one
+	for (int n = 0; n <= NO_SOCKETS; n++)
+	{
+		int i = netNode->rxTurn;
+		Ring *ring = netNode->rx[i];
+		ssize_t size = ring_length(ring) == 0 ? 0 : frameSize(ring, 0);
+
+		if (size < 0)
+		{
+			//A stream can not be resynchronized after an unknown type
+			log_warn("Unknown response: %d, dropping %zu bytes\n", ring_at(ring, 0), ring_length(ring));
+			ring_clear(ring);
+		}
+		else if (size > 0 && netNode->rxServed < netNode->config.socketBudget)
+		{
+			netNode->pduMessage = ring_peek(ring, size, netNode->pduScratch);
+			netNode->pduSize = size;
+			netNode->pduSocket = i;
+			netNode->rxServed++;
+			netNode->stats->pdus[netNode->pduMessage[0]]++;
+			return true;
+		}
+
+		netNode->rxTurn = (i + 1) % NO_SOCKETS;
+		netNode->rxServed = 0;
+	}
+
+	return false;
+}
+
+// Like nextMessage, but NET_RANGE_UPDATE, NET_GET_RANGE_MAP and
+// NET_GET_STATS are handled here in whatever state the node is in. They only
+// read or update node metadata, the state machine never sees them
+static bool nextStateMessage(struct NetNode *netNode)
+{
+	while (nextMessage(netNode))
+	{
+		if (netNode->pduMessage[0] == NET_RANGE_UPDATE)
+		{
+			updateRingMap(netNode);
+		}
+		else if (netNode->pduMessage[0] == NET_GET_RANGE_MAP)
+		{
+			sendRangeMap(netNode);
+		}
+		else if (netNode->pduMessage[0] == NET_GET_STATS)
+		{
+			sendStats(netNode);
+		}
+		else
+		{
+			return true;
+		}
+		consumeMessage(netNode);
+	}
+
+	return false;
+}
+
+// The UDP address of the node owning the hash, NULL if not known
+static const struct sockaddr_in *ownerOf(struct NetNode *netNode, hash_t hash)
+{
+	if (hash >= netNode->nodeRange.min && hash <= netNode->nodeRange.max)
+	{
+		return &netNode->udpAddr;
+	}
+	if (netNode->ringMap.seen[hash] == 0)
+	{
+		return NULL;
+	}
+
+	return &netNode->ringMap.owner[hash];
+}
+
+// Writes a NET_RANGE_MAP_RESPONSE with one entry per run of hashes that have
+// the same owner, and returns its size
+static size_t writeRangeMap(unsigned char *message, struct NetNode *netNode)
+{
+	uint16_t count = 0;
+	size_t size = RANGE_MAP_HEADER_SIZE;
+
+	int start = 0;
+	while (start < HASH_BUCKETS)
+	{
+		const struct sockaddr_in *owner = ownerOf(netNode, start);
+		int end = start;
+		while (end + 1 < HASH_BUCKETS)
+		{
+			const struct sockaddr_in *next = ownerOf(netNode, end + 1);
+			if (owner == NULL || next == NULL || next->sin_addr.s_addr != owner->sin_addr.s_addr ||
+				next->sin_port != owner->sin_port)
+			{
+				break;
+			}
+			end++;
+		}
+
+		if (owner != NULL)
+		{
+			message[size] = start;
+			message[size + 1] = end;
+			serializeUint32(&message[size + 2], owner->sin_addr.s_addr);
+			serializeUint16(&message[size + 6], owner->sin_port);
+			size += RANGE_MAP_ENTRY_SIZE;
+			count++;
+		}
+		start = end + 1;
+	}
+
+	//FNV-1a over the entries, so nodes agreeing on the map give it the same id
+	uint32_t mapId = 2166136261u;
+	for (size_t i = RANGE_MAP_HEADER_SIZE; i < size; i++)
+	{
+		mapId = (mapId ^ message[i]) * 16777619u;
+	}
+
+	message[0] = NET_RANGE_MAP_RESPONSE;
+	serializeUint32(&message[1], htonl(mapId));
+	serializeUint16(&message[5], htons(count));
+
+	return size;
+}
+
+// Answer a NET_GET_RANGE_MAP with the owners we know of
+static void sendRangeMap(struct NetNode *netNode)
+{
+	struct sockaddr_in senderAddr = {0};
+	senderAddr.sin_family = AF_INET;
+	senderAddr.sin_addr.s_addr = htonl(deserializeUint32(&netNode->pduMessage[1]));
+	senderAddr.sin_port = htons(deserializeUint16(&netNode->pduMessage[5]));
+
+	unsigned char message[RANGE_MAP_SIZE];
+	size_t size = writeRangeMap(message, netNode);
+
+	log_debug("\tSending NET_RANGE_MAP_RESPONSE with %d entries\n", (message[5] << 8) | message[6]);
+	sendDatagram(netNode, UDP_SOCKET_A, message, size, senderAddr, "Could not send NET_RANGE_MAP_RESPONSE");
+}
+
+// The state whose handler this is, lastState for exitState
+static eSystemState handlerState(pfEventHandler handler)
+{
+	for (int state = q1; state < lastState; state++)
+	{
+		if (handlers[state] == handler)
+		{
+			return state;
+		}
+	}
+
+	return lastState;
+}
+
+static size_t writeStats(unsigned char *message, struct NetNode *netNode)
+{
+	struct NodeStats *stats = netNode->stats;
+	size_t size = 0;
+
+	message[size++] = NET_STATS_RESPONSE;
+	serializeUint32(&message[size], htonl(entryCount(netNode)));
+	size += 4;
+	serializeUint64(&message[size], htobe64(log_dropped()));
+	size += 8;
+
+	message[size++] = lastEvent;
+	for (int event = 0; event < lastEvent; event++)
+	{
+		serializeUint64(&message[size], htobe64(stats->events[event]));
+		size += 8;
+	}
+
+	size_t pduCount = size++;
+	message[pduCount] = 0;
+	for (int type = 0; type < 256; type++)
+	{
+		if (stats->pdus[type] > 0)
+		{
+			message[size] = type;
+			serializeUint64(&message[size + 1], htobe64(stats->pdus[type]));
+			size += STATS_COUNTER_SIZE;
+			message[pduCount]++;
+		}
+	}
+
+	message[size++] = NO_SOCKETS;
+	for (int socket = 0; socket < NO_SOCKETS; socket++)
+	{
+		serializeUint64(&message[size], htobe64(stats->bytesIn[socket]));
+		serializeUint64(&message[size + 8], htobe64(stats->bytesOut[socket]));
+		size += 16;
+	}
+
+	size_t handlerCount = size++;
+	message[handlerCount] = 0;
+	for (int state = q1; state < lastState; state++)
+	{
+		const Histogram *histogram = &stats->handlers[state];
+		if (histogram_count(histogram) == 0)
+		{
+			continue;
+		}
+
+		uint64_t values[] = {histogram_count(histogram), histogram_min(histogram), histogram_percentile(histogram, 50),
+							 histogram_percentile(histogram, 90), histogram_percentile(histogram, 99), histogram_max(histogram)};
+		message[size] = state;
+		for (int i = 0; i < 6; i++)
+		{
+			serializeUint64(&message[size + 1 + 8 * i], htobe64(values[i]));
+		}
+		size += STATS_LATENCY_SIZE;
+		message[handlerCount]++;
+	}
+
+	return size;
+}
+
+// Answer a NET_GET_STATS with the counters since start up
+static void sendStats(struct NetNode *netNode)
+{
+	struct sockaddr_in senderAddr = {0};
+	senderAddr.sin_family = AF_INET;
+	senderAddr.sin_addr.s_addr = htonl(deserializeUint32(&netNode->pduMessage[1]));
+	senderAddr.sin_port = htons(deserializeUint16(&netNode->pduMessage[5]));
+
+	unsigned char message[STATS_SIZE];
+	size_t size = writeStats(message, netNode);
+
+	log_debug("\tSending NET_STATS_RESPONSE of %zu bytes\n", size);
+	sendDatagram(netNode, UDP_SOCKET_A, message, size, senderAddr, "Could not send NET_STATS_RESPONSE");
+}
+
+// Handles the expired timers among the events. True if the alive timer
+// expired while in the ring, which Q6 sees as eventTimeout. Joining and
+// leaving states have no transition for it
+static bool handleTimers(struct NetNode *netNode, const Event *events, int count)
+{
+	bool timeout = false;
+
+	for (int n = 0; n < count; n++)
+	{
+		if (!(events[n].flags & EVENT_TIMER))
+		{
+			continue;
+		}
+
+		if (events[n].tag == TIMER_ALIVE)
+		{
+			timeout = true;
+			sendAlive(netNode);
+			printHops(netNode);
+		}
+		else if (events[n].tag < TIMER_FLUSH)
+		{
+			handshakeTimeout(netNode, events[n].tag - TIMER_HANDSHAKE);
+		}
+		else if (events[n].tag < TIMER_LINGER)
+		{
+			flushTimeout(netNode, events[n].tag - TIMER_FLUSH);
+		}
+		else if (events[n].tag < TIMER_EXPIRY)
+		{
+			lingerTimeout(netNode, events[n].tag - TIMER_LINGER);
+		}
+		else
+		{
+			//The expiry is the owner of the timer, which is its first member
+			expireEntry(netNode, (struct EntryExpiry *)events[n].timer);
+		}
+	}
+
+	return timeout && netNode->alive;
+}
+
+// Send NET_ALIVE to the tracker while we are in the ring
+static void sendAlive(struct NetNode *netNode)
+{
+	if (!netNode->alive)
+	{
+		return;
+	}
+
+	unsigned char netAliveMessage[1] = {'\0'};
+	size_t messageSize = sizeof(netAliveMessage);
+	netAliveMessage[0] = NET_ALIVE;
+
+	sendDatagram(netNode, UDP_SOCKET_A, netAliveMessage, messageSize, netNode->fdsAddr[UDP_SOCKET_A], "Could not send NET_ALIVE to tracker");
+}
+
+// Tell the rest of the ring which range we own, through our successor. Only
+// called when the range changes, or the successor does
+static void announceRange(struct NetNode *netNode)
+{
+	if (netNode->fds[TCP_SOCKET_B].fd == 0 || netNode->udpAddr.sin_port == 0)
+	{
+		return;
+	}
+
+	unsigned char message[RANGE_UPDATE_SIZE];
+	writeRangeUpdate(message, netNode->nodeRange, netNode->udpAddr, UINT8_MAX);
+	sendToSocket(netNode, TCP_SOCKET_B, message, sizeof(message));
+}
+
+// Record the owner in a NET_RANGE_UPDATE and pass it on, unless it is our
+// own announcement coming back
+static void updateRingMap(struct NetNode *netNode)
+{
+	struct NET_RANGE_UPDATE_PDU rangeUpdate = readRangeUpdate(netNode->pduMessage);
+	struct sockaddr_in owner = {0};
+	owner.sin_family = AF_INET;
+	owner.sin_addr.s_addr = htonl(rangeUpdate.address);
+	owner.sin_port = htons(rangeUpdate.port);
+
+	if (owner.sin_addr.s_addr == netNode->udpAddr.sin_addr.s_addr && owner.sin_port == netNode->udpAddr.sin_port)
+	{
+		return;
+	}
+
+	uint64_t now = event_now_ms();
+	for (int hash = rangeUpdate.range_start; hash <= rangeUpdate.range_end; hash++)
+	{
+		netNode->ringMap.owner[hash] = owner;
+		netNode->ringMap.seen[hash] = now;
+	}
+
+	if (rangeUpdate.hops_left > 1 && netNode->fds[TCP_SOCKET_B].fd != 0)
+	{
+		netNode->pduMessage[9] = rangeUpdate.hops_left - 1;
+		sendToSocket(netNode, TCP_SOCKET_B, netNode->pduMessage, RANGE_UPDATE_SIZE);
+	}
+}
+
+// True if a hash outside our range is closer past our max than before our
+// min. Each node on the way sees the same side as closer, so a message never
+// turns back. Without a predecessor only the successor is left
+static bool routeClockwise(struct NetNode *netNode, hash_t hash)
+{
+	int clockwise = (hash - netNode->nodeRange.max) & (HASH_BUCKETS - 1);
+	int counterClockwise = (netNode->nodeRange.min - hash) & (HASH_BUCKETS - 1);
+
+	return clockwise <= counterClockwise || netNode->fds[TCP_SOCKET_D].fd == 0;
+}
+
+// The owner of the farthest finger, at our max + 2^i going clockwise or our
+// min - 2^i going counter-clockwise, that does not pass the hash. NULL if no
+// such owner is known and the neighbour should be used
+static const struct sockaddr_in *closestFinger(struct NetNode *netNode, hash_t hash, bool clockwise)
+{
+	int distance = clockwise ? (hash - netNode->nodeRange.max) & (HASH_BUCKETS - 1)
+							 : (netNode->nodeRange.min - hash) & (HASH_BUCKETS - 1);
+
+	//Finger 0 is the neighbour, which is reached over TCP anyway
+	for (int i = FINGERS - 1; i > 0; i--)
+	{
+		int step = 1 << i;
+		hash_t target = clockwise ? (netNode->nodeRange.max + step) & (HASH_BUCKETS - 1)
+								  : (netNode->nodeRange.min - step) & (HASH_BUCKETS - 1);
+		if (step > distance || netNode->ringMap.seen[target] == 0)
+		{
+			continue;
+		}
+		if (target >= netNode->nodeRange.min && target <= netNode->nodeRange.max)
+		{
+			continue;
+		}
+		return &netNode->ringMap.owner[target];
+	}
+
+	return NULL;
+}
+
+// Print the hop counts on an alive tick, if they changed since the last
+static void printHops(struct NetNode *netNode)
+{
+	struct HopCount *hops = &netNode->hops;
+	if (memcmp(hops, &netNode->hopsPrinted, sizeof(*hops)) == 0)
+	{
+		return;
+	}
+
+	netNode->hopsPrinted = *hops;
+	log_info("\tHops: %llu delivered, %llu forwarded to fingers, %llu to successor, %llu to predecessor\n",
+		   (unsigned long long)hops->delivered, (unsigned long long)hops->byFinger, (unsigned long long)hops->bySuccessor,
+		   (unsigned long long)hops->byPredecessor);
+}
+
+// Drop the current message from its receive ring
+static void consumeMessage(struct NetNode *netNode)
+{
+	if (netNode->pduSocket >= 0)
+	{
+		ring_consume(netNode->rx[netNode->pduSocket], netNode->pduSize);
+	}
+	netNode->pduSize = 0;
+	netNode->pduSocket = -1;
+}
+
+// Sockets that are connected, not closed by the peer and have room to
+// receive, for UDP sockets room for a whole datagram. Socket C only accepts
+// connections. Clients wait while the ring does not keep up with what they
+// send, TCP sockets are always read so two nodes never wait for each other
+static bool socketReadable(struct NetNode *netNode, int socket)
+{
+	bool datagrams = socket == UDP_SOCKET_A || socket == UDP_SOCKET_A2;
+	size_t room = datagrams ? BATCH_SIZE : 1;
+	return socket != TCP_SOCKET_C && netNode->fds[socket].fd != 0 && !netNode->connecting[socket] &&
+		   !netNode->rxClosed[socket] && ring_space(netNode->rx[socket]) >= room && !(datagrams && sendBacklogged(netNode));
+}
+
+// A send queue to the successor or predecessor grew past TX_SIZE
+static bool sendBacklogged(struct NetNode *netNode)
+{
+	return ring_length(netNode->tx[TCP_SOCKET_B]) > TX_SIZE || ring_length(netNode->tx[TCP_SOCKET_D]) > TX_SIZE;
+}
+
+// Read what is available on a socket straight into its receive ring
+static void receiveFromSocket(struct NetNode *netNode, int socket)
+{
+	Ring *ring = netNode->rx[socket];
+
+	if (event_loop_receiving(netNode->loop, netNode->fds[socket].fd))
+	{
+		takeReceived(netNode, socket);
+		return;
+	}
+	if (socket == UDP_SOCKET_A || socket == UDP_SOCKET_A2)
+	{
+		receiveDatagrams(netNode, socket);
+		return;
+	}
+	if (socket == TCP_SOCKET_D && passThrough(netNode))
+	{
+		return;
+	}
+
+	struct iovec iov[2];
+	int count = ring_free_iov(ring, iov);
+
+	ssize_t bytesRead = readv(netNode->fds[socket].fd, iov, count);
+	if (bytesRead == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+		return;
+	}
+	if (bytesRead <= 0)
+	{
+		netNode->rxClosed[socket] = true;
+		return;
+	}
+	ring_produce(ring, bytesRead);
+	netNode->stats->bytesIn[socket] += bytesRead;
+}
+
+// Read up to socketBudget datagrams with one recvmmsg and append them to the
+// receive ring, keeping a datagram only if it holds whole messages
+static void receiveDatagrams(struct NetNode *netNode, int socket)
+{
+	Ring *ring = netNode->rx[socket];
+	struct mmsghdr headers[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+
+	//Every datagram read must fit in the ring
+	size_t count = ring_space(ring) / BATCH_SIZE;
+	count = count < UDP_BATCH ? count : UDP_BATCH;
+	count = count < (size_t)netNode->config.socketBudget ? count : (size_t)netNode->config.socketBudget;
+
+	memset(headers, 0, count * sizeof(headers[0]));
+	for (size_t i = 0; i < count; i++)
+	{
+		iov[i].iov_base = &netNode->udpScratch[i * BATCH_SIZE];
+		iov[i].iov_len = BATCH_SIZE;
+		headers[i].msg_hdr.msg_iov = &iov[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	int received = recvmmsg(netNode->fds[socket].fd, headers, count, MSG_DONTWAIT, NULL);
+	for (int i = 0; i < received; i++)
+	{
+		appendDatagram(netNode, socket, iov[i].iov_base, headers[i].msg_len, headers[i].msg_hdr.msg_flags & MSG_TRUNC);
+	}
+}
+
+// Move what the event loop received for a socket into its receive ring,
+// up to socketBudget datagrams or parts of the stream
+static void takeReceived(struct NetNode *netNode, int socket)
+{
+	Ring *ring = netNode->rx[socket];
+	int fd = netNode->fds[socket].fd;
+	bool datagrams = socket == UDP_SOCKET_A || socket == UDP_SOCKET_A2;
+	const unsigned char *data;
+	size_t size;
+
+	for (int i = 0; i < netNode->config.socketBudget && (data = event_loop_received(netNode->loop, fd, &size)) != NULL; i++)
+	{
+		if (datagrams)
+		{
+			if (ring_space(ring) < BATCH_SIZE)
+			{
+				return;
+			}
+			//A buffer filled to the last byte held a datagram larger than any message
+			appendDatagram(netNode, socket, data, size, size == URING_DATAGRAM_BUFFER);
+			event_loop_consume(netNode->loop, fd, size);
+		}
+		else
+		{
+			size = size < ring_space(ring) ? size : ring_space(ring);
+			if (size == 0)
+			{
+				return;
+			}
+			ring_write(ring, data, size);
+			netNode->stats->bytesIn[socket] += size;
+			event_loop_consume(netNode->loop, fd, size);
+		}
+	}
+
+	int error;
+	if (event_loop_received(netNode->loop, fd, &size) == NULL && event_loop_receive_ended(netNode->loop, fd, &error))
+	{
+		if (!datagrams)
+		{
+			netNode->rxClosed[socket] = true;
+			return;
+		}
+		//A new receive is armed for the socket
+		log_warn("Receiving datagrams failed, receiving again: %s\n", strerror(error));
+		event_loop_receive_stop(netNode->loop, fd);
+		netNode->receiving[socket] = false;
+	}
+}
+
+// Messages from the predecessor that we would only forward to the successor
+// are moved there with splice, one at a time. Only the bytes that frame a
+// message and tell whose it is are peeked, names and emails are never read
+// except the name of a VAL_INSERT, which sits before its email length.
+// Returns false if the first message has to be read
+static bool passThrough(struct NetNode *netNode)
+{
+	int fd = netNode->fds[TCP_SOCKET_D].fd;
+	unsigned char header[PASS_PEEK_SIZE];
+	int passed = 0;
+
+	if (netNode->passPipe[0] == 0 || !netNode->alive || ring_length(netNode->rx[TCP_SOCKET_D]) > 0 || netNode->fds[TCP_SOCKET_B].fd == 0 ||
+		netNode->connecting[TCP_SOCKET_B] || (ring_length(netNode->tx[TCP_SOCKET_B]) > 0 && !flushSocket(netNode, TCP_SOCKET_B)))
+	{
+		return false;
+	}
+
+	while (passed < netNode->config.socketBudget)
+	{
+		int available = 0;
+		if (ioctl(fd, FIONREAD, &available) == -1)
+		{
+			break;
+		}
+		size_t size = peekFrame(fd, header, available);
+		if (size == 0)
+		{
+			break;
+		}
+
+		unsigned char type = header[0];
+		char ssn[SSN_LENGTH + 1] = {'\0'};
+		memcpy(ssn, &header[1], SSN_LENGTH);
+		hash_t hash = hash_ssn(ssn);
+		if ((hash >= netNode->nodeRange.min && hash <= netNode->nodeRange.max) || !routeClockwise(netNode, hash) ||
+			(type == VAL_LOOKUP && closestFinger(netNode, hash, true) != NULL))
+		{
+			break;
+		}
+
+		netNode->stats->pdus[type]++;
+		netNode->stats->bytesIn[TCP_SOCKET_D] += size;
+		netNode->hops.bySuccessor++;
+		PROBE3(pdu_received, type, size, TCP_SOCKET_D);
+		PROBE3(val_forward, type, hash, PROBE_VIA_SUCCESSOR);
+		log_debug("\tPassing %zu bytes through to successor\n", size);
+		spliceToSuccessor(netNode, size);
+		passed++;
+	}
+
+	return passed > 0;
+}
+
+// Size of the VAL_INSERT, VAL_LOOKUP or VAL_REMOVE that has arrived whole at
+// the head of a socket, peeking into header only the type, the ssn and for
+// VAL_INSERT the lengths. 0 if another message is first or it is not all
+// there yet
+static size_t peekFrame(int fd, unsigned char *header, size_t available)
+{
+	//type, ssn and the name length of a VAL_INSERT
+	size_t need = SSN_LENGTH + 2;
+	size_t size;
+
+	ssize_t peeked = recv(fd, header, available < need ? available : need, MSG_PEEK | MSG_DONTWAIT);
+	if (peeked < 1 + SSN_LENGTH)
+	{
+		return 0;
+	}
+
+	switch (header[0])
+	{
+	case VAL_LOOKUP:
+		size = LOOKUP_SIZE;
+		break;
+	case VAL_REMOVE:
+		size = REMOVE_SIZE;
+		break;
+	case VAL_INSERT:
+		//The email length follows the name
+		if (peeked < (ssize_t)need)
+		{
+			return 0;
+		}
+		need = SSN_LENGTH + 3 + header[SSN_LENGTH + 1];
+		if (available < need || recv(fd, header, need, MSG_PEEK | MSG_DONTWAIT) != (ssize_t)need)
+		{
+			return 0;
+		}
+		size = need + header[need - 1];
+		break;
+	default:
+		return 0;
+	}
+
+	return available < size ? 0 : size;
+}
+
+// Move bytes that wait on socket D to socket B through the pipe. What the
+// successor does not take at once is queued like any other send
+static void spliceToSuccessor(struct NetNode *netNode, size_t size)
+{
+	int from = netNode->fds[TCP_SOCKET_D].fd;
+	int to = netNode->fds[TCP_SOCKET_B].fd;
+	unsigned char chunk[PASS_CHUNK_SIZE];
+
+	while (size > 0)
+	{
+		ssize_t moved = splice(from, NULL, netNode->passPipe[1], NULL, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (moved == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (moved <= 0)
+		{
+			//The message has arrived whole, so it can always be read
+			moved = recv(from, chunk, size < sizeof(chunk) ? size : sizeof(chunk), MSG_DONTWAIT);
+			if (moved <= 0)
+			{
+				exit_on_error("Could not pass messages through", netNode);
+			}
+			sendToSocket(netNode, TCP_SOCKET_B, chunk, moved);
+			size -= moved;
+			continue;
+		}
+		size -= moved;
+
+		//Queued bytes go first, after them nothing more can be spliced
+		while (moved > 0 && ring_length(netNode->tx[TCP_SOCKET_B]) == 0)
+		{
+			ssize_t sent = splice(netNode->passPipe[0], NULL, to, NULL, moved, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (sent == -1 && errno == EINTR)
+			{
+				continue;
+			}
+			if (sent <= 0)
+			{
+				break;
+			}
+			netNode->stats->bytesOut[TCP_SOCKET_B] += sent;
+			moved -= sent;
+		}
+		while (moved > 0)
+		{
+			ssize_t bytesRead = read(netNode->passPipe[0], chunk, (size_t)moved < sizeof(chunk) ? (size_t)moved : sizeof(chunk));
+			if (bytesRead == -1 && errno == EINTR)
+			{
+				continue;
+			}
+			if (bytesRead <= 0)
+			{
+				exit_on_error("Could not pass messages through", netNode);
+			}
+			sendToSocket(netNode, TCP_SOCKET_B, chunk, bytesRead);
+			moved -= bytesRead;
+		}
+	}
+}
+
+// Append a datagram to the receive ring of a socket, keeping it only if it
+// holds whole messages
+static void appendDatagram(struct NetNode *netNode, int socket, const unsigned char *data, size_t size, bool truncated)
+{
+	Ring *ring = netNode->rx[socket];
+	size_t length = ring_length(ring);
+
+	ring_write(ring, data, size);
+	netNode->stats->bytesIn[socket] += size;
+
+	size_t offset = length;
+	ssize_t frame;
+	while (offset < ring_length(ring) && (frame = frameSize(ring, offset)) > 0)
+	{
+		offset += frame;
+	}
+	if (offset != ring_length(ring) || truncated)
+	{
+		log_warn("Dropping malformed datagram of %zu bytes\n", size);
+		ring_truncate(ring, length);
+	}
+}
+
+// Queue a lookup response, it is sent with the others of this loop pass.
+// Gathered responses share a datagram with earlier ones to the same address
+static void queueResponse(struct NetNode *netNode, const unsigned char *message, size_t size, struct sockaddr_in addr, bool gather)
+{
+	struct ResponseBatch *batch = netNode->responses;
+	for (int i = batch->count - 1; gather && i >= 0; i--)
+	{
+		if (batch->gather[i] && batch->addrs[i].sin_addr.s_addr == addr.sin_addr.s_addr && batch->addrs[i].sin_port == addr.sin_port &&
+			batch->iov[i].iov_len + size <= GATHER_SIZE)
+		{
+			memcpy(&batch->messages[i][batch->iov[i].iov_len], message, size);
+			batch->iov[i].iov_len += size;
+			return;
+		}
+	}
+
+	if (batch->count == UDP_BATCH)
+	{
+		flushResponses(netNode);
+	}
+	if (batch->count == 0)
+	{
+		event_timer_start(netNode->loop, &netNode->flushTimer[UDP_SOCKET_A], TIMER_FLUSH + UDP_SOCKET_A, netNode->config.flushDelay, 0);
+	}
+
+	int i = batch->count++;
+	memcpy(batch->messages[i], message, size);
+	batch->gather[i] = gather;
+	batch->addrs[i] = addr;
+	batch->iov[i].iov_base = batch->messages[i];
+	batch->iov[i].iov_len = size;
+	memset(&batch->headers[i], 0, sizeof(batch->headers[i]));
+	batch->headers[i].msg_hdr.msg_name = &batch->addrs[i];
+	batch->headers[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+	batch->headers[i].msg_hdr.msg_iov = &batch->iov[i];
+	batch->headers[i].msg_hdr.msg_iovlen = 1;
+}
+
+// Send the queued lookup responses with sendmmsg. Like sendDatagram,
+// responses the socket buffer has no room for are dropped
+static void flushResponses(struct NetNode *netNode)
+{
+	struct ResponseBatch *batch = netNode->responses;
+	int sent = 0;
+
+	event_timer_stop(netNode->loop, &netNode->flushTimer[UDP_SOCKET_A]);
+
+	//With io_uring the responses go out with the next wait instead
+	while (sent < batch->count && event_loop_send(netNode->loop, netNode->fds[UDP_SOCKET_A].fd, batch->messages[sent], batch->iov[sent].iov_len, &batch->addrs[sent]))
+	{
+		netNode->stats->bytesOut[UDP_SOCKET_A] += batch->iov[sent].iov_len;
+		sent++;
+	}
+	while (sent < batch->count)
+	{
+		int count = sendmmsg(netNode->fds[UDP_SOCKET_A].fd, &batch->headers[sent], batch->count - sent, MSG_DONTWAIT);
+		if (count == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			log_warn("Could not send response to tracker, dropping %d responses: %s\n", batch->count - sent, strerror(errno));
+			break;
+		}
+		for (int i = sent; i < sent + count; i++)
+		{
+			netNode->stats->bytesOut[UDP_SOCKET_A] += batch->headers[i].msg_len;
+		}
+		sent += count;
+	}
+
+	batch->count = 0;
+}
+
+// Close a socket and drop what was received on it. What is still queued
+// for it is sent by the loop afterwards, see lingerSocket
+static void closeSocket(struct NetNode *netNode, int socket)
+{
+	bool queued = netNode->fds[socket].fd != 0 && !netNode->connecting[socket] && ring_length(netNode->tx[socket]) > 0 && !flushSocket(netNode, socket);
+	netNode->connecting[socket] = false;
+	stopHandshakeTimer(netNode, socket);
+	event_timer_stop(netNode->loop, &netNode->flushTimer[socket]);
+	if (netNode->watched[socket] != 0)
+	{
+		event_loop_unwatch(netNode->loop, netNode->watchedFd[socket]);
+		netNode->watched[socket] = 0;
+	}
+
+	if (netNode->receiving[socket])
+	{
+		event_loop_receive_stop(netNode->loop, netNode->fds[socket].fd);
+		netNode->receiving[socket] = false;
+	}
+
+	if (!queued || !lingerSocket(netNode, socket))
+	{
+		shutdown(netNode->fds[socket].fd, SHUT_WR);
+		close(netNode->fds[socket].fd);
+	}
+	netNode->fds[socket].fd = 0;
+
+	ring_clear(netNode->rx[socket]);
+	ring_clear(netNode->tx[socket]);
+	shrinkQueue(netNode->tx[socket]);
+	netNode->rxClosed[socket] = false;
+	if (netNode->pduSocket == socket)
+	{
+		netNode->pduSize = 0;
+		netNode->pduSocket = -1;
+	}
+}
+
+// Watch a socket for what it waits for: reads while its receive ring has
+// room and writes while its send queue is not empty. Sockets waiting for
+// nothing are not watched, so a closed peer does not wake the loop
+static void updateInterest(struct NetNode *netNode, int socket)
+{
+	int fd = netNode->fds[socket].fd;
+	uint32_t flags = 0;
+
+	//With io_uring a connected socket keeps receiving, even while unwatched
+	if (!netNode->receiving[socket] && event_loop_backend(netNode->loop) == EVENT_BACKEND_URING && fd != 0 &&
+		socket != TCP_SOCKET_C && !netNode->connecting[socket])
+	{
+		bool datagrams = socket == UDP_SOCKET_A || socket == UDP_SOCKET_A2;
+		netNode->receiving[socket] = event_loop_receive(netNode->loop, fd, datagrams ? URING_DATAGRAM_BUFFER : URING_STREAM_BUFFER, URING_BUFFERS);
+	}
+
+	if (socket == TCP_SOCKET_C ? netNode->accepting : socketReadable(netNode, socket))
+	{
+		flags |= EVENT_READ;
+	}
+	if (fd != 0 && (netNode->connecting[socket] || ring_length(netNode->tx[socket]) > 0))
+	{
+		flags |= EVENT_WRITE;
+	}
+
+	if (netNode->watched[socket] != 0 && netNode->watchedFd[socket] != fd)
+	{
+		//The slot was given a new socket
+		event_loop_unwatch(netNode->loop, netNode->watchedFd[socket]);
+		netNode->watched[socket] = 0;
+	}
+	if (flags == netNode->watched[socket])
+	{
+		return;
+	}
+
+	if (flags == 0)
+	{
+		event_loop_unwatch(netNode->loop, fd);
+	}
+	else
+	{
+		setNonBlocking(netNode, fd);
+		if (!event_loop_watch(netNode->loop, fd, flags, socket))
+		{
+			exit_on_error("Could not watch socket", netNode);
+		}
+	}
+	netNode->watched[socket] = flags;
+	netNode->watchedFd[socket] = fd;
+}
+
+static void setNonBlocking(struct NetNode *netNode, int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+	{
+		exit_on_error("fcntl error", netNode);
+	}
+}
+
+// Queue a message for a TCP socket. Queued messages are sent together when
+// the loop goes idle, once flushBytes have been queued since the last flush,
+// or when the flush timer expires, so a busy loop does not delay them
+// without bound
+static void sendToSocket(struct NetNode *netNode, int socket, const void *message, size_t size)
+{
+	Ring *tx = netNode->tx[socket];
+
+	if (ring_length(tx) == 0)
+	{
+		netNode->txFlushed[socket] = 0;
+		event_timer_start(netNode->loop, &netNode->flushTimer[socket], TIMER_FLUSH + socket, netNode->config.flushDelay, 0);
+	}
+
+	if (!ring_write(tx, message, size))
+	{
+		//Queue full, send what the socket takes and grow the queue for the
+		//rest. Clients wait meanwhile, see socketReadable
+		if (netNode->fds[socket].fd != 0)
+		{
+			flushSocket(netNode, socket);
+		}
+		size_t capacity = tx->capacity;
+		while (capacity - ring_length(tx) < size)
+		{
+			capacity *= 2;
+		}
+		if (capacity != tx->capacity && !ring_resize(tx, capacity))
+		{
+			exit_on_error("Could not grow send queue", netNode);
+		}
+		ring_write(tx, message, size);
+	}
+
+	if (netNode->fds[socket].fd != 0 && ring_length(tx) - netNode->txFlushed[socket] >= (size_t)netNode->config.flushBytes)
+	{
+		flushSocket(netNode, socket);
+	}
+}
+
+// Queued bytes, or lookup responses on A, waited flushDelay ms
+static void flushTimeout(struct NetNode *netNode, int socket)
+{
+	if (socket == UDP_SOCKET_A && netNode->responses->count > 0)
+	{
+		flushResponses(netNode);
+	}
+	if (ring_length(netNode->tx[socket]) > 0 && netNode->fds[socket].fd != 0)
+	{
+		flushSocket(netNode, socket);
+	}
+}
+
+// Send a datagram, dropping it if the socket buffer is full. With io_uring
+// it is sent by the next wait, together with the others
+static void sendDatagram(struct NetNode *netNode, int socket, const void *message, size_t size, struct sockaddr_in addr, const char *error)
+{
+	if (event_loop_send(netNode->loop, netNode->fds[socket].fd, message, size, &addr))
+	{
+		netNode->stats->bytesOut[socket] += size;
+		return;
+	}
+	if (sendto(netNode->fds[socket].fd, message, size, MSG_DONTWAIT, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			exit_on_error(error, netNode);
+		}
+		log_warn("%s: socket buffer full, dropping %zu bytes\n", error, size);
+		return;
+	}
+	netNode->stats->bytesOut[socket] += size;
+}
+
+// Send as much of the send queue as the socket takes. Returns true when
+// the queue is empty. A failing socket drops its queue
+static bool flushSocket(struct NetNode *netNode, int socket)
+{
+	Ring *tx = netNode->tx[socket];
+	size_t sent = 0;
+
+	//Whatever is left is sent when the socket takes it, or after another delay.
+	//Without a delay the socket taking it is enough, a due timer would spin
+	if (netNode->config.flushDelay > 0)
+	{
+		event_timer_start(netNode->loop, &netNode->flushTimer[socket], TIMER_FLUSH + socket, netNode->config.flushDelay, 0);
+	}
+	if (netNode->connecting[socket] && !finishConnect(netNode, socket))
+	{
+		netNode->txFlushed[socket] = ring_length(tx);
+		return false;
+	}
+
+	int result = sendQueue(netNode->fds[socket].fd, tx, &sent);
+	netNode->stats->bytesOut[socket] += sent;
+	if (result == 0)
+	{
+		netNode->txFlushed[socket] = ring_length(tx);
+		return false;
+	}
+
+	event_timer_stop(netNode->loop, &netNode->flushTimer[socket]);
+	shrinkQueue(tx);
+	return true;
+}
+
+// Send a queue with one sendmsg (writev that does not raise SIGPIPE) per
+// contiguous part, until the socket takes no more. Returns 1 when the queue
+// is empty, 0 when the socket is full and -1 when it failed, which drops
+// the queue. "sent" is set to the bytes sent
+static int sendQueue(int fd, Ring *tx, size_t *sent)
+{
+	struct iovec iov[2];
+	struct msghdr header = {};
+
+	*sent = 0;
+	while (ring_length(tx) > 0)
+	{
+		header.msg_iov = iov;
+		header.msg_iovlen = ring_data_iov(tx, iov);
+
+		ssize_t bytesSent = sendmsg(fd, &header, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (bytesSent == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				return 0;
+			}
+			log_error("Could not send queued bytes: %s\n", strerror(errno));
+			ring_clear(tx);
+			return -1;
+		}
+		ring_consume(tx, bytesSent);
+		*sent += bytesSent;
+	}
+
+	return 1;
+}
+
+// A queue that grew for a slow peer goes back to TX_SIZE once it is empty
+static void shrinkQueue(Ring *tx)
+{
+	if (tx->capacity > TX_SIZE && ring_length(tx) == 0)
+	{
+		ring_resize(tx, TX_SIZE);
+	}
+}
+
+// Hand a closed socket with a queue to a free lingering slot, whose queue
+// is swapped in. False if every slot is taken, the queue is dropped then
+static bool lingerSocket(struct NetNode *netNode, int socket)
+{
+	for (int slot = 0; slot < LINGER_SOCKETS; slot++)
+	{
+		struct Lingering *lingering = &netNode->lingering[slot];
+		if (lingering->fd != 0)
+		{
+			continue;
+		}
+
+		Ring *tx = lingering->tx;
+		lingering->tx = netNode->tx[socket];
+		netNode->tx[socket] = tx;
+		lingering->fd = netNode->fds[socket].fd;
+		lingering->socket = socket;
+
+		setNonBlocking(netNode, lingering->fd);
+		if (!event_loop_watch(netNode->loop, lingering->fd, EVENT_WRITE, LINGERING + slot))
+		{
+			exit_on_error("Could not watch socket", netNode);
+		}
+		event_timer_start(netNode->loop, &lingering->timer, TIMER_LINGER + slot, netNode->config.handshakeTimeout, 0);
+		log_debug("\tClosing socket %d once %zu queued bytes are sent\n", socket, ring_length(lingering->tx));
+		return true;
+	}
+
+	log_warn("Too many sockets closing, dropping %zu queued bytes\n", ring_length(netNode->tx[socket]));
+	return false;
+}
+
+// A lingering socket can take more of its queue
+static void flushLingering(struct NetNode *netNode, int slot)
+{
+	struct Lingering *lingering = &netNode->lingering[slot];
+	size_t sent = 0;
+
+	if (lingering->fd == 0)
+	{
+		return;
+	}
+
+	int result = sendQueue(lingering->fd, lingering->tx, &sent);
+	netNode->stats->bytesOut[lingering->socket] += sent;
+	if (result != 0)
+	{
+		closeLingering(netNode, slot);
+	}
+	else if (sent > 0)
+	{
+		//The peer is slow, not gone
+		event_timer_start(netNode->loop, &lingering->timer, TIMER_LINGER + slot, netNode->config.handshakeTimeout, 0);
+	}
+}
+
+static void closeLingering(struct NetNode *netNode, int slot)
+{
+	struct Lingering *lingering = &netNode->lingering[slot];
+
+	event_loop_unwatch(netNode->loop, lingering->fd);
+	event_timer_stop(netNode->loop, &lingering->timer);
+	shutdown(lingering->fd, SHUT_WR);
+	close(lingering->fd);
+	lingering->fd = 0;
+	ring_clear(lingering->tx);
+	shrinkQueue(lingering->tx);
+}
+
+// A lingering socket took nothing for handshakeTimeout ms
+static void lingerTimeout(struct NetNode *netNode, int slot)
+{
+	struct Lingering *lingering = &netNode->lingering[slot];
+
+	if (lingering->fd != 0)
+	{
+		log_warn("Socket %d took nothing for %d ms, dropping %zu queued bytes\n", lingering->socket, netNode->config.handshakeTimeout,
+				 ring_length(lingering->tx));
+		closeLingering(netNode, slot);
+	}
+}
+
+static int lingeringSockets(struct NetNode *netNode)
+{
+	int count = 0;
+	for (int slot = 0; slot < LINGER_SOCKETS; slot++)
+	{
+		if (netNode->lingering[slot].fd != 0)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+// Let the lingering sockets send their queues before the node ends. Only
+// their writes and timers are handled, a signal closes them at once
+static void drainLingering(struct NetNode *netNode)
+{
+	Event events[NO_SOCKETS + 1 + LINGER_SOCKETS + EXPIRED_BATCH];
+
+	while (netNode->loop != NULL && lingeringSockets(netNode) > 0)
+	{
+		int count = event_loop_wait(netNode->loop, events, NO_SOCKETS + 1 + LINGER_SOCKETS + EXPIRED_BATCH, -1);
+		if (count == -1)
+		{
+			break;
+		}
+		for (int n = 0; n < count; n++)
+		{
+			if ((events[n].flags & EVENT_TIMER) && events[n].tag >= TIMER_LINGER && events[n].tag < TIMER_EXPIRY)
+			{
+				lingerTimeout(netNode, events[n].tag - TIMER_LINGER);
+			}
+			else if (!(events[n].flags & EVENT_TIMER) && events[n].tag >= LINGERING)
+			{
+				flushLingering(netNode, events[n].tag - LINGERING);
+			}
+			else if (!(events[n].flags & EVENT_TIMER) && events[n].tag == WORKER_REPLIES)
+			{
+				//The replies are taken when the workers are stopped
+				uint64_t signals;
+				while (read(netNode->replyFd, &signals, sizeof(signals)) == -1 && errno == EINTR)
+				{
+				}
+			}
+		}
+	}
+
+	for (int slot = 0; slot < LINGER_SOCKETS; slot++)
+	{
+		if (netNode->lingering[slot].fd != 0)
+		{
+			log_warn("Closing with %zu bytes still queued\n", ring_length(netNode->lingering[slot].tx));
+			closeLingering(netNode, slot);
+		}
+	}
+}
+
+// Start connecting a socket to its address in fdsAddr. Sends are queued
+// until the event loop sees the connection complete
+static void connectSocket(struct NetNode *netNode, int slot)
+{
+	netNode->fds[slot].fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (netNode->fds[slot].fd == -1)
+	{
+		exit_on_error("Could not open socket to successor", netNode);
+	}
+	setNonBlocking(netNode, netNode->fds[slot].fd);
+
+	socklen_t addrLen = sizeof(netNode->fdsAddr[slot]);
+	if (connect(netNode->fds[slot].fd, (struct sockaddr *)&netNode->fdsAddr[slot], addrLen) == -1 && errno != EINPROGRESS)
+	{
+		exit_on_error("Could not connect to successor", netNode);
+	}
+
+	//Even a connect that completed at once is finished by the loop
+	netNode->connecting[slot] = true;
+	startHandshakeTimer(netNode, slot);
+}
+
+// Check if a pending connect has completed. Returns false while it is in
+// progress, a failed connect ends the node like a blocking connect did
+static bool finishConnect(struct NetNode *netNode, int socket)
+{
+	struct pollfd pollFd = {.fd = netNode->fds[socket].fd, .events = POLLOUT};
+	if (poll(&pollFd, 1, 0) != 1)
+	{
+		return false;
+	}
+
+	int error = 0;
+	socklen_t errorLen = sizeof(error);
+	if (getsockopt(netNode->fds[socket].fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) == -1 || error != 0)
+	{
+		//Nothing queued for a socket that never connected is sent
+		error = error != 0 ? error : errno;
+		closeSocket(netNode, socket);
+		errno = error;
+		exit_on_error("Could not connect to successor", netNode);
+	}
+
+	netNode->connecting[socket] = false;
+	stopHandshakeTimer(netNode, socket);
+
+	log_info("\tConnected to new successor V4(%s:%d)\n", inet_ntoa(netNode->fdsAddr[socket].sin_addr), ntohs(netNode->fdsAddr[socket].sin_port));
+	return true;
+}
+
+// Let the event loop accept the next connection on socket C as predecessor
+static void acceptPredecessor(struct NetNode *netNode)
+{
+	netNode->accepting = true;
+	startHandshakeTimer(netNode, TCP_SOCKET_C);
+}
+
+static void finishAccept(struct NetNode *netNode)
+{
+	if (!netNode->accepting)
+	{
+		return;
+	}
+
+	socklen_t addrLenD = sizeof(netNode->fdsAddr[TCP_SOCKET_D]);
+	int fd = accept(netNode->fds[TCP_SOCKET_C].fd, (struct sockaddr *)&netNode->fdsAddr[TCP_SOCKET_D], &addrLenD);
+	if (fd == -1)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED)
+		{
+			return;
+		}
+		exit_on_error("Could not accept from predecessor", netNode);
+	}
+
+	netNode->fds[TCP_SOCKET_D].fd = fd;
+	netNode->accepting = false;
+	stopHandshakeTimer(netNode, TCP_SOCKET_C);
+
+	log_info("\tAccepted new predecessor V4(%s:%d)\n", inet_ntoa(netNode->fdsAddr[TCP_SOCKET_D].sin_addr), ntohs(netNode->fdsAddr[TCP_SOCKET_D].sin_port));
+}
+
+static void startHandshakeTimer(struct NetNode *netNode, int socket)
+{
+	event_timer_start(netNode->loop, &netNode->handshakeTimer[socket], TIMER_HANDSHAKE + socket, netNode->config.handshakeTimeout, 0);
+}
+
+static void stopHandshakeTimer(struct NetNode *netNode, int socket)
+{
+	if (netNode->loop)
+	{
+		event_timer_stop(netNode->loop, &netNode->handshakeTimer[socket]);
+	}
+}
+
+// A connect that times out ends the node, like a blocking connect did. A
+// missing predecessor is only reported, socket C keeps accepting and the
+// node keeps serving until it connects
+static void handshakeTimeout(struct NetNode *netNode, int socket)
+{
+	if (socket == TCP_SOCKET_C && netNode->accepting)
+	{
+		log_warn("No predecessor connected within %d ms, still waiting\n", netNode->config.handshakeTimeout);
+		startHandshakeTimer(netNode, TCP_SOCKET_C);
+	}
+	else if (netNode->connecting[socket])
+	{
+		closeSocket(netNode, socket);
+		errno = ETIMEDOUT;
+		exit_on_error("Could not connect to successor", netNode);
+	}
 }
 
-static void printAddress(struct sockaddr_in addr)
+// Memory held by the store divided by the number of stored entries
+static int bytesPerEntry(struct NetNode *netNode)
 {
-	printf("%s:%d", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+	size_t length = entryCount(netNode);
+	return length == 0 ? 0 : (int)(entryMemory(netNode) / length);
 }
 
 // --------- DEBUG FUNCTIONS ---------- //
@@ -1,6 +1,8 @@
 #ifndef NODE_H
 #define NODE_H
 
+#define _GNU_SOURCE // recvmmsg, sendmmsg and splice
+
 #define UDP_SOCKET_A 0  // Tracker to and from
 #define TCP_SOCKET_B 1  // To succ.
 #define TCP_SOCKET_C 2  // Accept new TCP 
@@ -18,6 +20,47 @@
 #define REMOVE_SIZE 13
 #define LOOKUP_SIZE 19
 #define STUN_RESP_SIZE 5
+#define RANGE_UPDATE_SIZE 10
+#define GET_RANGE_MAP_SIZE 7
+#define RANGE_MAP_HEADER_SIZE 7
+#define RANGE_MAP_ENTRY_SIZE 8
+#define RANGE_MAP_SIZE (RANGE_MAP_HEADER_SIZE + HASH_BUCKETS * RANGE_MAP_ENTRY_SIZE) // Largest NET_RANGE_MAP_RESPONSE
+#define GET_STATS_SIZE 7
+#define STATS_COUNTER_SIZE 9
+#define STATS_LATENCY_SIZE 49
+#define STATS_SIZE (17 + lastEvent * 8 + 256 * STATS_COUNTER_SIZE + NO_SOCKETS * 16 + lastState * STATS_LATENCY_SIZE) // Largest NET_STATS_RESPONSE
+#define BATCH_HEADER_SIZE 5
+#define BATCH_SIZE 8192 // Largest VAL_INSERT_BATCH, header included
+#define LOOKUP_MULTI_HEADER_SIZE 9 // Largest VAL_LOOKUP_MULTI is BATCH_SIZE too
+
+#define RX_SIZE 65536 // Receive ring per socket, power of two
+#define UDP_BATCH 32 // Datagrams per recvmmsg or sendmmsg
+#define UDP_RX_SIZE 262144 // Receive ring of a UDP socket, room for UDP_BATCH datagrams
+#define RESPONSE_SIZE (3 + SSN_LENGTH + 2 * 255) // Largest VAL_LOOKUP_RESPONSE
+#define GATHER_SIZE 1472 // Largest datagram of gathered VAL_LOOKUP_RESPONSEs, one Ethernet frame
+#define TX_SIZE 65536 // Send queue per socket, power of two, grown while the peer is slow
+#define LINGER_SOCKETS 4 // Closed sockets that may still be sending their queue
+#define ALIVE_INTERVAL_MS 5000 // Default time between NET_ALIVE messages
+#define SOCKET_BUDGET 16 // Default messages per socket before the next socket gets a turn
+#define HANDSHAKE_TIMEOUT_MS 5000 // Default time for a connect or accept to complete
+#define FLUSH_BYTES 16384 // Default queued bytes that are sent without waiting for idle
+#define FLUSH_DELAY_MS 2 // Default time queued bytes wait for the loop to go idle
+#define ENTRY_TTL_MS 0 // Default time an entry is kept after its last insert, 0 to keep it
+#define EXPIRED_BATCH 16 // Expired timers handled at a time
+#define FINGERS 8 // Fingers at our max + 2^i and our min - 2^i, for i < FINGERS
+#define WORKERS 0 // Default worker threads owning the entries, 0 to keep them on the I/O thread
+#define MAX_WORKERS 32
+#define WORKER_SLOTS 4096 // Messages queued to and from each worker, power of two
+#define WORKER_SLOT_SIZE (sizeof(struct sockaddr_in) + 1 + RESPONSE_SIZE) // Largest VAL_* message or reply
+#define WORKER_REPLIES NO_SOCKETS // Event tag of the eventfd workers signal replies on
+#define LINGERING (WORKER_REPLIES + 1) // Event tag of a lingering socket, plus its slot
+#define IO_URING 0 // Default, 1 to use io_uring for the sockets when the kernel has it
+#define URING_BUFFERS 64 // Receive buffers per socket with io_uring, power of two
+#define URING_STREAM_BUFFER 16384 // Receive buffer of a TCP socket with io_uring
+#define URING_DATAGRAM_BUFFER (BATCH_SIZE + 1) // One more than the largest datagram, to see larger ones
+#define PASS_PEEK_SIZE (SSN_LENGTH + 3 + UINT8_MAX) // Most bytes peeked to frame a message passing through, a VAL_INSERT up to its email length
+#define PASS_CHUNK_SIZE 4096 // Bytes copied at a time when splicing a message through fails
+#define PASS_PIPE_SIZE (1 << 20) // Pipe that passes messages through, room for many small segments
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,10 +76,29 @@
 #include <sys/socket.h>
 #include <netinet/ip.h>
 #include <poll.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <endian.h>
 
 #include "pdu.h"
-#include "datatypes/list.h"
+#include "datatypes/store.h"
+#include "datatypes/ring.h"
 #include "datatypes/hash.h"
+#include "datatypes/histogram.h"
+#include "event.h"
+#include "log.h"
+#include "probes.h"
+#include "worker.h"
+
+#define TIMER_ALIVE 0 // Tag of the timer that sends NET_ALIVE
+#define TIMER_HANDSHAKE 1 // Tag of the handshake timer of a socket, plus the socket
+#define TIMER_FLUSH (TIMER_HANDSHAKE + NO_SOCKETS) // Tag of the flush timer of a socket, plus the socket
+#define TIMER_LINGER (TIMER_FLUSH + NO_SOCKETS) // Tag of the timer of a lingering socket, plus its slot
+#define TIMER_EXPIRY (TIMER_LINGER + LINGER_SOCKETS) // Tag of the timer of an entry with a TTL
 
 typedef enum {
     firstState,
@@ -85,17 +147,140 @@ typedef enum {
     lastEvent
 } eSystemEvent;
 
+// A VAL_INSERT_BATCH being filled before it is sent to the successor
+struct InsertBatch {
+    unsigned char message[BATCH_SIZE];
+    size_t size;
+    uint16_t count;
+};
+
+// Lookup responses produced during a loop pass, sent with one sendmmsg
+struct ResponseBatch {
+    unsigned char messages[UDP_BATCH][GATHER_SIZE];
+    bool gather[UDP_BATCH]; // Answers of VAL_LOOKUP_MULTI, more may be added
+    struct sockaddr_in addrs[UDP_BATCH];
+    struct iovec iov[UDP_BATCH];
+    struct mmsghdr headers[UDP_BATCH];
+    int count;
+};
+
+// The TTL of a stored entry, kept in a list per hash bucket so it can be
+// found again when the entry is inserted again, removed or transferred
+struct EntryExpiry {
+    EventTimer timer;
+    struct EntryExpiry *prev;
+    struct EntryExpiry *next;
+    char ssn[SSN_LENGTH + 1];
+};
+
+// Who owns each hash as far as we know, learned from NET_RANGE_UPDATE.
+// Ranges are only announced when they change, and the new owner of a range
+// always announces it, so an entry stays until another owner replaces it
+struct RingMap {
+    struct sockaddr_in owner[HASH_BUCKETS]; // UDP address of the owner
+    uint64_t seen[HASH_BUCKETS];            // When the owner was announced, 0 if never
+};
+
+// Where VAL_* messages went, to compare hops per request between setups
+struct HopCount {
+    uint64_t delivered;   // Handled here
+    uint64_t byFinger;    // Forwarded to a finger over UDP
+    uint64_t bySuccessor; // Forwarded to the successor over TCP
+    uint64_t byPredecessor; // Forwarded to the predecessor over TCP
+};
+
+// Counted from start up, sent in NET_STATS_RESPONSE
+struct NodeStats {
+    uint64_t events[lastEvent];   // Events read, per eSystemEvent
+    uint64_t pdus[256];           // Messages received, per PDU type
+    uint64_t bytesIn[NO_SOCKETS]; // Bytes received, per socket
+    uint64_t bytesOut[NO_SOCKETS]; // Bytes sent, per socket
+    Histogram handlers[lastState]; // ns spent in gotoStateQn, at index qn
+};
+
+// A closed socket still sending the queue it had, so closing never waits
+// for a slow peer. Closed once the queue is empty or the peer took nothing
+// for handshakeTimeout ms
+struct Lingering {
+    int fd;        // 0 if the slot is free
+    int socket;    // Socket it was closed as, for the byte counters
+    Ring *tx;      // The queue, swapped with the empty one of the socket
+    EventTimer timer;
+};
+
+// A message the inbox of a worker had no room for
+struct PendingPost {
+    struct PendingPost *next;
+    size_t size;
+    unsigned char message[];
+};
+
+// Buckets owned by a worker thread, those with bucket % workers == index.
+// Only the worker touches the store, except while the worker is idle
+struct Shard {
+    Store *entries;
+    Worker *worker;
+    struct PendingPost *pending;      // Posted once the inbox has room, in order
+    struct PendingPost **pendingTail;
+    atomic_size_t length; // Entries in the store, readable from any thread
+    atomic_size_t memory; // Bytes held by the store, readable from any thread
+};
+
 typedef struct Range {
     int min;
     int max;
 } Range;
 
+// Tunables, read from the environment at start up
+typedef struct NodeConfig {
+    int socketBudget; // NODE_SOCKET_BUDGET: messages (and datagrams read) per socket and turn
+    int handshakeTimeout; // NODE_HANDSHAKE_TIMEOUT_MS: ms for a connect or accept to complete
+    int flushBytes; // NODE_FLUSH_BYTES: bytes queued since the last flush that trigger one
+    int flushDelay; // NODE_FLUSH_DELAY_MS: ms queued bytes may wait for the loop to go idle, 0 to send after each handler
+    int aliveInterval; // NODE_ALIVE_INTERVAL_MS: ms between NET_ALIVE messages
+    int entryTtl; // NODE_ENTRY_TTL_MS: ms an entry is kept after its last insert, 0 to keep it
+    int workers; // NODE_WORKERS: threads owning the entries, 0 to keep them on the I/O thread
+    int ioUring; // NODE_IO_URING: 1 to receive and send through io_uring, epoll stays the fallback
+} NodeConfig;
+
 struct NetNode {
     struct pollfd fds[NO_SOCKETS];
     struct sockaddr_in fdsAddr[NO_SOCKETS];
-    List *entries;
+    Ring *rx[NO_SOCKETS];      // Received bytes not yet handled, per socket
+    bool rxClosed[NO_SOCKETS]; // Peer closed the stream
+    Ring *tx[NO_SOCKETS];      // Bytes waiting to be sent, per socket
+    size_t txFlushed[NO_SOCKETS];   // Bytes left in tx by the last flush
+    EventLoop *loop;
+    uint32_t watched[NO_SOCKETS]; // EVENT_* flags the socket is watched for
+    int watchedFd[NO_SOCKETS];    // Descriptor the flags were registered for
+    bool receiving[NO_SOCKETS];   // The loop receives for the socket, with io_uring
+    bool connecting[NO_SOCKETS];  // connect() in progress, sends are queued
+    bool accepting;               // Waiting for a predecessor to connect to socket C
+    struct Lingering lingering[LINGER_SOCKETS];
+    EventTimer aliveTimer;
+    EventTimer handshakeTimer[NO_SOCKETS]; // Runs while a connect or accept is pending
+    EventTimer flushTimer[NO_SOCKETS];     // Runs while queued bytes, or responses on A, wait
+    struct EntryExpiry *expiries[HASH_BUCKETS]; // Only used with an entry TTL
+    bool alive;                   // In the ring, NET_ALIVE is sent to the tracker
+    Store *entries;               // Only used without workers
+    struct Shard shards[MAX_WORKERS]; // One per worker
+    int replyFd;                  // eventfd the workers signal replies on
+    int passPipe[2];              // Moves messages from D to B without reading them, 0 if none
     Range nodeRange;
-    unsigned char *pduMessage;
+    struct sockaddr_in udpAddr; // Our UDP address as others reach it
+    struct RingMap ringMap;
+    struct HopCount hops;
+    struct HopCount hopsPrinted; // hops when they were last printed
+    struct NodeStats *stats;
+    unsigned char *pduMessage; // Current message, in rx or pduScratch
+    size_t pduSize;            // Size of the current message, 0 if none
+    int pduSocket;             // Socket the current message came from, -1 if none
+    unsigned char *pduScratch; // Current message when it wraps in rx
+    unsigned char *udpScratch; // UDP_BATCH datagrams of BATCH_SIZE for recvmmsg
+    struct ResponseBatch *responses;
+    int rxTurn;                // Socket whose messages are handled now
+    int rxServed;              // Messages handled from rxTurn during this turn
+    NodeConfig config;
 };
 
 typedef eSystemState(*const afEventHandler[lastState][lastEvent])(struct NetNode *netNode);
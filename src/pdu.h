@@ -14,11 +14,18 @@
 #define NET_NEW_RANGE 6
 #define NET_LEAVING 7
 #define NET_NEW_RANGE_RESPONSE 8
+#define NET_RANGE_UPDATE 9
+#define NET_GET_RANGE_MAP 10
+#define NET_RANGE_MAP_RESPONSE 11
+#define NET_GET_STATS 12
+#define NET_STATS_RESPONSE 13
 
 #define VAL_INSERT 100
 #define VAL_REMOVE 101
 #define VAL_LOOKUP 102
 #define VAL_LOOKUP_RESPONSE 103
+#define VAL_INSERT_BATCH 104
+#define VAL_LOOKUP_MULTI 105
 
 #define STUN_LOOKUP 200
 #define STUN_RESPONSE 201
@@ -77,6 +84,82 @@ struct NET_LEAVING_PDU {
     uint16_t new_port;
 };
 
+// The node reached on UDP at address:port owns the range. Sent when the
+// range changes and passed on around the ring until it is back at that node
+// or hops_left runs out
+struct NET_RANGE_UPDATE_PDU {
+    uint8_t type;
+    uint8_t range_start;
+    uint8_t range_end;
+    uint32_t address;
+    uint16_t port;
+    uint8_t hops_left;
+};
+
+struct NET_GET_RANGE_MAP_PDU {
+    uint8_t type;
+    uint32_t sender_address;
+    uint16_t sender_port;
+};
+
+struct NET_RANGE_MAP_ENTRY {
+    uint8_t range_start;
+    uint8_t range_end;
+    uint32_t address; // UDP address of the owner
+    uint16_t port;
+};
+
+// "count" entries follow the header, ordered by range_start. Hashes that no
+// entry covers have no known owner. "map_id" is the same on every node that
+// sees the same map, and changes whenever the map does
+struct NET_RANGE_MAP_RESPONSE_PDU {
+    uint8_t type;
+    uint32_t map_id;
+    uint16_t count;
+    struct NET_RANGE_MAP_ENTRY* entries;
+};
+
+struct NET_GET_STATS_PDU {
+    uint8_t type;
+    uint32_t sender_address;
+    uint16_t sender_port;
+};
+
+struct NET_STATS_COUNTER {
+    uint8_t type;
+    uint64_t count;
+};
+
+// Time spent in a state handler, in ns. The values are upper bounds within
+// 12.5% of the real value, except min and max which are exact
+struct NET_STATS_LATENCY {
+    uint8_t state;
+    uint64_t count;
+    uint64_t min;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t max;
+};
+
+// Every field after "type" is repeated "*_count" times. "events" is indexed
+// by event number and "bytes" holds bytes in, then bytes out, per socket.
+// Only PDU types and handlers that were seen are listed. Counters start when
+// the node does and are never reset
+struct NET_STATS_RESPONSE_PDU {
+    uint8_t type;
+    uint32_t entries;
+    uint64_t log_dropped;
+    uint8_t event_count;
+    uint64_t* events;
+    uint8_t pdu_count;
+    struct NET_STATS_COUNTER* pdus;
+    uint8_t socket_count;
+    uint64_t* bytes;
+    uint8_t handler_count;
+    struct NET_STATS_LATENCY* handlers;
+};
+
 struct VAL_INSERT_PDU {
     uint8_t type;
     uint8_t ssn[SSN_LENGTH];
@@ -86,6 +169,14 @@ struct VAL_INSERT_PDU {
     uint8_t* email;
 };
 
+// "count" VAL_INSERT PDUs, "length" bytes in all, follow the header
+struct VAL_INSERT_BATCH_PDU {
+    uint8_t type;
+    uint16_t count;
+    uint16_t length;
+    uint8_t* records;
+};
+
 struct VAL_REMOVE_PDU {
     uint8_t type;
     uint8_t ssn[SSN_LENGTH];
@@ -98,6 +189,19 @@ struct VAL_LOOKUP_PDU {
     uint16_t sender_port;
 };
 
+// "count" ssns follow the header. Every node answers the ssns it owns and
+// passes the others on to its successor. Its answers are VAL_LOOKUP_RESPONSE
+// PDUs, put back to back in as few datagrams as they fit in
+struct VAL_LOOKUP_MULTI_PDU {
+    uint8_t type;
+    uint32_t sender_address;
+    uint16_t sender_port;
+    uint16_t count;
+    uint8_t* ssns;
+};
+
+// Sent by the owner for every lookup, an ssn it does not store gets an
+// empty name and email
 struct VAL_LOOKUP_RESPONSE_PDU {
     uint8_t type;
     uint8_t ssn[SSN_LENGTH];
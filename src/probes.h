@@ -0,0 +1,56 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/**
+ * @defgroup probes probes.h
+ * @brief Static tracepoints (USDT) of the provider "node".
+ * With <sys/sdt.h> (systemtap-sdt-dev) each probe is a single nop and a
+ * note in the binary, so it costs nothing until perf or bpftrace attaches
+ * to it, e.g.
+ *
+ *     bpftrace -e 'usdt:./node:node:handler_done { @[arg0] = hist(arg2); }'
+ *
+ * Without the header, or with NODE_NO_PROBES defined, the probes are
+ * compiled out. Arguments are then not evaluated, but still count as used.
+ *
+ * Probes and their arguments:
+ * - handler_start(state, event, handler): a transition of the state
+ *   machine is about to run gotoStateQn, "handler" is n, or lastState for
+ *   exitState.
+ * - handler_done(handler, next state, ns): the handler returned.
+ * - pdu_received(type, size, socket): a message reached the state machine.
+ * - val_store(type, hash): a VAL_* message is handled here.
+ * - val_forward(type, hash, via): a VAL_* message is forwarded, "via" is
+ *   PROBE_VIA_FINGER, PROBE_VIA_SUCCESSOR or PROBE_VIA_PREDECESSOR.
+ * - transfer_range(min, max, entries, bytes): entries of hashes min to max
+ *   were sent to the successor.
+ *
+ * @{
+ */
+
+#define PROBE_VIA_FINGER 0
+#define PROBE_VIA_SUCCESSOR 1
+#define PROBE_VIA_PREDECESSOR 2
+
+#if !defined(NODE_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define NODE_PROBES 1
+#endif
+#endif
+
+#ifdef NODE_PROBES
+#define PROBE2(name, a, b) DTRACE_PROBE2(node, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(node, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(node, name, a, b, c, d)
+#else
+#define PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define PROBE3(name, a, b, c) (PROBE2(name, a, b), (void)sizeof(c))
+#define PROBE4(name, a, b, c, d) (PROBE3(name, a, b, c), (void)sizeof(d))
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* PROBES_H */
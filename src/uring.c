@@ -0,0 +1,430 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+#if defined(__has_include) && !defined(NODE_NO_URING)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+//Multishot receives into buffer rings are the newest thing used
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#define URING_SUPPORTED
+#endif
+
+#ifdef URING_SUPPORTED
+
+#define URING_FEATURES (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_SUBMIT_STABLE | IORING_FEAT_EXT_ARG)
+
+/**
+ * The submission and completion rings share one mapping. "sqLocal" runs
+ * ahead of the shared tail by the requests queued since the last submit.
+ */
+struct uring
+{
+    int fd;
+    unsigned char *rings;
+    size_t ringsSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned sqLocal;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe *cqes;
+};
+
+/**
+ * "ring" is shared with the kernel, "tail" is ours until it is published.
+ */
+struct uring_buffers
+{
+    struct io_uring_buf_ring *ring;
+    size_t ringSize;
+    unsigned char *memory;
+    size_t size;
+    unsigned count;
+    uint16_t group;
+    uint16_t tail;
+    bool registered;
+};
+
+static struct io_uring_sqe *next_sqe(Uring *ring);
+static void free_ring(Uring *ring);
+static void free_buffers(Uring *ring, UringBuffers *buffers);
+
+//(The user has to free up memory.)
+Uring *uring_create(unsigned entries, unsigned completions)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+    params.cq_entries = completions;
+
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd == -1 && errno == EINVAL)
+    {
+        //Older kernels do not know the hints, the ring works without them
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = completions;
+        fd = syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    if ((params.features & URING_FEATURES) != URING_FEATURES)
+    {
+        close(fd);
+        errno = ENOSYS;
+        return NULL;
+    }
+
+    Uring *ring = calloc(1, sizeof(Uring));
+    if (ring == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ringsSize = sqSize > cqSize ? sqSize : cqSize;
+    ring->rings = mmap(NULL, ring->ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->rings == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        int error = errno;
+        free_ring(ring);
+        errno = error;
+        return NULL;
+    }
+
+    ring->sqHead = (unsigned *)(ring->rings + params.sq_off.head);
+    ring->sqTail = (unsigned *)(ring->rings + params.sq_off.tail);
+    ring->sqArray = (unsigned *)(ring->rings + params.sq_off.array);
+    ring->sqMask = *(unsigned *)(ring->rings + params.sq_off.ring_mask);
+    ring->sqEntries = params.sq_entries;
+    ring->sqLocal = *ring->sqTail;
+    ring->cqHead = (unsigned *)(ring->rings + params.cq_off.head);
+    ring->cqTail = (unsigned *)(ring->rings + params.cq_off.tail);
+    ring->cqMask = *(unsigned *)(ring->rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(ring->rings + params.cq_off.cqes);
+
+    return ring;
+}
+
+//(FREEING UP MEMORY.)
+void uring_destroy(Uring *ring)
+{
+    free_ring(ring);
+}
+
+bool uring_poll(Uring *ring, int fd, uint32_t events, uint64_t userData)
+{
+    struct io_uring_sqe *sqe = next_sqe(ring);
+    if (sqe == NULL)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool uring_cancel(Uring *ring, uint64_t target, uint64_t userData)
+{
+    struct io_uring_sqe *sqe = next_sqe(ring);
+    if (sqe == NULL)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool uring_receive(Uring *ring, int fd, UringBuffers *buffers, uint64_t userData)
+{
+    struct io_uring_sqe *sqe = next_sqe(ring);
+    if (sqe == NULL)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffers->group;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool uring_sendmsg(Uring *ring, int fd, const struct msghdr *header, uint64_t userData)
+{
+    struct io_uring_sqe *sqe = next_sqe(ring);
+    if (sqe == NULL)
+    {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)header;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool uring_enter(Uring *ring, bool wait, int timeoutMs)
+{
+    //Requests an interrupted enter did not take are submitted again
+    __atomic_store_n(ring->sqTail, ring->sqLocal, __ATOMIC_RELEASE);
+    unsigned submit = ring->sqLocal - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    if (submit == 0 && !wait)
+    {
+        return true;
+    }
+
+    struct __kernel_timespec timeout = {.tv_sec = timeoutMs / 1000, .tv_nsec = (timeoutMs % 1000) * 1000000L};
+    struct io_uring_getevents_arg arg = {.ts = timeoutMs < 0 ? 0 : (uint64_t)(uintptr_t)&timeout};
+    unsigned flags = IORING_ENTER_EXT_ARG | (wait ? IORING_ENTER_GETEVENTS : 0);
+
+    if (syscall(__NR_io_uring_enter, ring->fd, submit, wait ? 1 : 0, flags, &arg, sizeof(arg)) == -1)
+    {
+        //A timeout, or completions backing up, leaves completions to take
+        return errno == ETIME || errno == EBUSY;
+    }
+    return true;
+}
+
+bool uring_next(Uring *ring, UringCompletion *completion)
+{
+    unsigned head = *ring->cqHead;
+    if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+
+    struct io_uring_cqe *cqe = &ring->cqes[head & ring->cqMask];
+    completion->userData = cqe->user_data;
+    completion->result = cqe->res;
+    completion->more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    completion->buffer = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+
+    //The kernel may reuse the entry once it sees the new head
+    __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+//(The user has to free up memory.)
+UringBuffers *uring_buffers_create(Uring *ring, uint16_t group, unsigned count, size_t size)
+{
+    UringBuffers *buffers = calloc(1, sizeof(UringBuffers));
+    if (buffers == NULL)
+    {
+        return NULL;
+    }
+    buffers->size = size;
+    buffers->count = count;
+    buffers->group = group;
+
+    //The kernel wants the ring page aligned, which a mapping is
+    buffers->ringSize = count * sizeof(struct io_uring_buf);
+    buffers->ring = mmap(NULL, buffers->ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers->ring == MAP_FAILED)
+    {
+        buffers->ring = NULL;
+    }
+    buffers->memory = malloc(count * size);
+    if (buffers->ring == NULL || buffers->memory == NULL)
+    {
+        free_buffers(ring, buffers);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)buffers->ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    {
+        int error = errno;
+        free_buffers(ring, buffers);
+        errno = error;
+        return NULL;
+    }
+    buffers->registered = true;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        uring_buffer_recycle(buffers, i);
+    }
+
+    return buffers;
+}
+
+//(FREEING UP MEMORY.)
+void uring_buffers_destroy(Uring *ring, UringBuffers *buffers)
+{
+    free_buffers(ring, buffers);
+}
+
+void *uring_buffer(UringBuffers *buffers, int buffer)
+{
+    return buffers->memory + (size_t)buffer * buffers->size;
+}
+
+void uring_buffer_recycle(UringBuffers *buffers, int buffer)
+{
+    struct io_uring_buf *entry = &buffers->ring->bufs[buffers->tail & (buffers->count - 1)];
+    entry->addr = (uintptr_t)uring_buffer(buffers, buffer);
+    entry->len = buffers->size;
+    entry->bid = buffer;
+    buffers->tail++;
+
+    //The kernel reads the entry once it sees the new tail
+    __atomic_store_n(&buffers->ring->tail, buffers->tail, __ATOMIC_RELEASE);
+}
+
+// Queue a request, submitting the queued ones first if the ring is full
+static struct io_uring_sqe *next_sqe(Uring *ring)
+{
+    if (ring->sqLocal - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) == ring->sqEntries)
+    {
+        uring_enter(ring, false, 0);
+        if (ring->sqLocal - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) == ring->sqEntries)
+        {
+            return NULL;
+        }
+    }
+
+    unsigned index = ring->sqLocal & ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqArray[index] = index;
+    ring->sqLocal++;
+    return sqe;
+}
+
+// Free a ring that may be only partly set up
+static void free_ring(Uring *ring)
+{
+    if (ring->rings != NULL && ring->rings != MAP_FAILED)
+    {
+        munmap(ring->rings, ring->ringsSize);
+    }
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    close(ring->fd);
+    free(ring);
+}
+
+// Free a group of buffers that may be only partly set up
+static void free_buffers(Uring *ring, UringBuffers *buffers)
+{
+    if (buffers->registered)
+    {
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.bgid = buffers->group;
+        syscall(__NR_io_uring_register, ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    if (buffers->ring != NULL)
+    {
+        munmap(buffers->ring, buffers->ringSize);
+    }
+    free(buffers->memory);
+    free(buffers);
+}
+
+#else
+
+// Without io_uring every ring fails to set up, so nothing else is called
+
+Uring *uring_create(unsigned entries, unsigned completions)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+void uring_destroy(Uring *ring)
+{
+}
+
+bool uring_poll(Uring *ring, int fd, uint32_t events, uint64_t userData)
+{
+    return false;
+}
+
+bool uring_cancel(Uring *ring, uint64_t target, uint64_t userData)
+{
+    return false;
+}
+
+bool uring_receive(Uring *ring, int fd, UringBuffers *buffers, uint64_t userData)
+{
+    return false;
+}
+
+bool uring_sendmsg(Uring *ring, int fd, const struct msghdr *header, uint64_t userData)
+{
+    return false;
+}
+
+bool uring_enter(Uring *ring, bool wait, int timeoutMs)
+{
+    errno = ENOSYS;
+    return false;
+}
+
+bool uring_next(Uring *ring, UringCompletion *completion)
+{
+    return false;
+}
+
+UringBuffers *uring_buffers_create(Uring *ring, uint16_t group, unsigned count, size_t size)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+void uring_buffers_destroy(Uring *ring, UringBuffers *buffers)
+{
+}
+
+void *uring_buffer(UringBuffers *buffers, int buffer)
+{
+    return NULL;
+}
+
+void uring_buffer_recycle(UringBuffers *buffers, int buffer)
+{
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/**
+ * @defgroup uring uring.h
+ * @brief The header file for the functions used to talk to io_uring.
+ * A thin layer over the io_uring system calls, without liburing. Requests
+ * are queued in the submission ring and handed to the kernel together by
+ * the next "uring_enter", which also waits for completions. Every request
+ * carries a 64 bit value chosen by the user that is returned with its
+ * completion. Receives take their memory from a buffer group, buffers the
+ * user registers up front and gives back once it has read them.
+ *
+ * Kernels or headers without io_uring, or built with NODE_NO_URING, get
+ * versions of the functions that fail, so callers need no checks of their
+ * own.
+ *
+ * @{
+ */
+
+typedef struct uring Uring;
+typedef struct uring_buffers UringBuffers;
+
+/**
+ * @brief A completed request.
+ *
+ * "result" is what the system call would have returned, or minus errno.
+ * "more" is set while a multishot request stays armed. "buffer" is the
+ * buffer the data was received into, -1 for none.
+ */
+typedef struct uring_completion
+{
+    uint64_t userData;
+    int32_t result;
+    bool more;
+    int buffer;
+} UringCompletion;
+
+/**
+ * @brief Sets up a ring, if the kernel has what the event loop needs.
+ *
+ * <b>OBS</b>: The user has to free up memory with "uring_destroy".
+ * @param unsigned Requests that can be queued between two submits.
+ * @param unsigned Completions that can wait to be taken.
+ * @return *Uring A pointer to the ring, or NULL with errno set.
+ */
+Uring *uring_create(unsigned entries, unsigned completions);
+
+/**
+ * @brief Closes the ring, the kernel cancels what is still running.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ * @param Uring* Pointer to a ring.
+ * @return Void
+ */
+void uring_destroy(Uring *ring);
+
+/**
+ * @brief Queues a one shot poll of a descriptor.
+ *
+ * The completion holds the POLL* events that are ready.
+ * @param Uring* Pointer to a ring.
+ * @param int The descriptor.
+ * @param uint32_t POLL* events to wait for.
+ * @param uint64_t Returned with the completion.
+ * @return Bool False if the request could not be queued.
+ */
+bool uring_poll(Uring *ring, int fd, uint32_t events, uint64_t userData);
+
+/**
+ * @brief Queues a cancel of an earlier request.
+ *
+ * The cancelled request completes with -ECANCELED, unless it completed
+ * first.
+ * @param Uring* Pointer to a ring.
+ * @param uint64_t The user data of the request to cancel.
+ * @param uint64_t Returned with the completion of the cancel itself.
+ * @return Bool False if the request could not be queued.
+ */
+bool uring_cancel(Uring *ring, uint64_t target, uint64_t userData);
+
+/**
+ * @brief Queues a multishot receive into a buffer group.
+ *
+ * Every datagram, or every part of a stream, completes on its own with
+ * "more" set, until the request ends. It ends with -ENOBUFS when the group
+ * has no free buffer left.
+ * @param Uring* Pointer to a ring.
+ * @param int The socket.
+ * @param UringBuffers* The buffer group to receive into.
+ * @param uint64_t Returned with the completions.
+ * @return Bool False if the request could not be queued.
+ */
+bool uring_receive(Uring *ring, int fd, UringBuffers *buffers, uint64_t userData);
+
+/**
+ * @brief Queues a sendmsg.
+ *
+ * The message header and what it points to have to stay valid until
+ * the request completes.
+ * @param Uring* Pointer to a ring.
+ * @param int The socket.
+ * @param msghdr* The message.
+ * @param uint64_t Returned with the completion.
+ * @return Bool False if the request could not be queued.
+ */
+bool uring_sendmsg(Uring *ring, int fd, const struct msghdr *header, uint64_t userData);
+
+/**
+ * @brief Submits the queued requests and waits for completions, with one
+ * system call.
+ *
+ * @param Uring* Pointer to a ring.
+ * @param bool Wait for at least one completion, or only submit.
+ * @param int Longest wait in ms, -1 for no limit.
+ * @return Bool False with errno set if the wait was interrupted or failed,
+ * a wait that times out succeeds.
+ */
+bool uring_enter(Uring *ring, bool wait, int timeoutMs);
+
+/**
+ * @brief Takes the oldest completion.
+ *
+ * @param Uring* Pointer to a ring.
+ * @param UringCompletion* Filled with the completion.
+ * @return Bool False if there is none.
+ */
+bool uring_next(Uring *ring, UringCompletion *completion);
+
+/**
+ * @brief Registers a group of receive buffers, all of them free.
+ *
+ * <b>OBS</b>: The user has to free up memory with "uring_buffers_destroy",
+ * once no receive uses the group.
+ * @param Uring* Pointer to a ring.
+ * @param uint16_t The group id, unique in the ring.
+ * @param unsigned The number of buffers, a power of two.
+ * @param size_t The size of each buffer.
+ * @return *UringBuffers A pointer to the group, or NULL with errno set.
+ */
+UringBuffers *uring_buffers_create(Uring *ring, uint16_t group, unsigned count, size_t size);
+
+/**
+ * @brief Unregisters and deallocates a group of buffers.
+ *
+ * <b>OBS</b>: Freeing up memory, use cautiously.
+ * @param Uring* Pointer to the ring the group is registered with.
+ * @param UringBuffers* Pointer to a group.
+ * @return Void
+ */
+void uring_buffers_destroy(Uring *ring, UringBuffers *buffers);
+
+/**
+ * @brief Returns the memory of a buffer.
+ *
+ * @param UringBuffers* Pointer to a group.
+ * @param int The buffer, as returned in a completion.
+ * @return Void* The start of the buffer.
+ */
+void *uring_buffer(UringBuffers *buffers, int buffer);
+
+/**
+ * @brief Gives a buffer back to the kernel to receive into.
+ *
+ * @param UringBuffers* Pointer to a group.
+ * @param int The buffer, as returned in a completion.
+ * @return Void
+ */
+void uring_buffer_recycle(UringBuffers *buffers, int buffer);
+
+/**
+ * @}
+ */
+
+#endif /* URING_H */
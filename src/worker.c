@@ -0,0 +1,192 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "worker.h"
+#include "log.h"
+
+static void *worker_main(void *arg);
+static void signal_fd(int fd);
+static void free_worker(Worker *worker);
+
+//(The user has to stop the worker.)
+Worker *worker_create(WorkerHandler handler, void *context, size_t slots, size_t slotSize, int replyFd)
+{
+    Worker *worker = calloc(1, sizeof(Worker));
+    if (worker == NULL)
+    {
+        return NULL;
+    }
+
+    worker->handler = handler;
+    worker->context = context;
+    worker->replyFd = replyFd;
+    worker->inbox = mailbox_create(slots, slotSize);
+    worker->outbox = mailbox_create(slots, slotSize);
+    worker->wakeFd = eventfd(0, EFD_CLOEXEC);
+    atomic_init(&worker->handled, 0);
+    atomic_init(&worker->sleeping, false);
+    atomic_init(&worker->stopping, false);
+    atomic_init(&worker->notify, false);
+    if (worker->inbox == NULL || worker->outbox == NULL || worker->wakeFd == -1)
+    {
+        free_worker(worker);
+        return NULL;
+    }
+
+    //Signals are for the owner, not for the workers
+    sigset_t all;
+    sigset_t old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int error = pthread_create(&worker->thread, NULL, worker_main, worker);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (error != 0)
+    {
+        free_worker(worker);
+        return NULL;
+    }
+
+    return worker;
+}
+
+//(FREEING UP MEMORY.)
+void worker_destroy(Worker *worker)
+{
+    atomic_store(&worker->stopping, true);
+    signal_fd(worker->wakeFd);
+    pthread_join(worker->thread, NULL);
+    free_worker(worker);
+}
+
+bool worker_post(Worker *worker, const void *message, size_t size)
+{
+    if (!mailbox_push(worker->inbox, message, size))
+    {
+        //The worker may have emptied the inbox before it saw the request
+        worker_notify(worker);
+        if (!mailbox_push(worker->inbox, message, size))
+        {
+            return false;
+        }
+    }
+    worker->posted++;
+
+    //Pairs with the fence in worker_main, either the worker sees the
+    //message before it sleeps or we see it sleeping
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&worker->sleeping, memory_order_relaxed))
+    {
+        signal_fd(worker->wakeFd);
+    }
+
+    return true;
+}
+
+void worker_notify(Worker *worker)
+{
+    //Pairs with the fence in worker_main, either the worker sees the
+    //request or we see it idle
+    atomic_store_explicit(&worker->notify, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+bool worker_idle(Worker *worker)
+{
+    return atomic_load_explicit(&worker->handled, memory_order_acquire) == worker->posted;
+}
+
+bool worker_reply(Worker *worker, const void *reply, size_t size)
+{
+    if (!mailbox_push(worker->outbox, reply, size))
+    {
+        return false;
+    }
+    worker->replied = true;
+    return true;
+}
+
+void *worker_reply_front(Worker *worker, size_t *size)
+{
+    return mailbox_front(worker->outbox, size);
+}
+
+void worker_reply_pop(Worker *worker)
+{
+    mailbox_pop(worker->outbox);
+}
+
+static void *worker_main(void *arg)
+{
+    Worker *worker = arg;
+    size_t handled = 0;
+
+    log_attach();
+    while (true)
+    {
+        size_t size;
+        void *message = mailbox_front(worker->inbox, &size);
+        if (message != NULL)
+        {
+            worker->handler(worker, message, size, worker->context);
+            mailbox_pop(worker->inbox);
+            atomic_store_explicit(&worker->handled, ++handled, memory_order_release);
+            continue;
+        }
+
+        //Out of messages, let the owner take the replies in one go
+        atomic_thread_fence(memory_order_seq_cst);
+        bool notify = atomic_exchange_explicit(&worker->notify, false, memory_order_relaxed);
+        if ((worker->replied || notify) && worker->replyFd != -1)
+        {
+            worker->replied = false;
+            signal_fd(worker->replyFd);
+        }
+
+        atomic_store_explicit(&worker->sleeping, true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (mailbox_empty(worker->inbox))
+        {
+            if (atomic_load(&worker->stopping))
+            {
+                break;
+            }
+
+            uint64_t count;
+            while (read(worker->wakeFd, &count, sizeof(count)) == -1 && errno == EINTR)
+            {
+            }
+        }
+        atomic_store_explicit(&worker->sleeping, false, memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+static void signal_fd(int fd)
+{
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) == -1 && errno == EINTR)
+    {
+    }
+}
+
+// Free a worker whose thread is not running, or was never started
+static void free_worker(Worker *worker)
+{
+    if (worker->inbox != NULL)
+    {
+        mailbox_destroy(worker->inbox);
+    }
+    if (worker->outbox != NULL)
+    {
+        mailbox_destroy(worker->outbox);
+    }
+    if (worker->wakeFd != -1)
+    {
+        close(worker->wakeFd);
+    }
+    free(worker);
+}
@@ -0,0 +1,142 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "datatypes/mailbox.h"
+
+/**
+ * @defgroup worker worker.h
+ * @brief The header file for the functions used by worker threads.
+ * A worker is a thread that handles the messages one other thread, the
+ * owner, posts to it, in the order they were posted. Replies go back to
+ * the owner the same way. Both directions are mailboxes, so neither
+ * thread takes a lock. A worker sleeps on an eventfd when it has nothing
+ * to do and is only woken when a message is posted to it while it sleeps.
+ * When it runs out of messages after replying, or after the owner asked
+ * with "worker_notify", it writes to the reply descriptor, so the owner
+ * can wait for replies and for room in the inbox in its event loop.
+ *
+ * @{
+ */
+
+typedef struct worker Worker;
+
+/**
+ * @brief Handles a message on the worker thread.
+ *
+ * The message is only valid during the call.
+ */
+typedef void (*WorkerHandler)(Worker *worker, void *message, size_t size, void *context);
+
+/**
+ * @brief The structure for a "worker".
+ *
+ * "posted" is only used by the owner and "replied" only by the worker.
+ */
+struct worker
+{
+    pthread_t thread;
+    Mailbox *inbox;  // Owner to worker
+    Mailbox *outbox; // Worker to owner
+    WorkerHandler handler;
+    void *context;
+    int wakeFd;  // eventfd the worker sleeps on
+    int replyFd; // eventfd written when replies are waiting, -1 for none
+    size_t posted;
+    bool replied;
+    atomic_size_t handled;
+    atomic_bool sleeping;
+    atomic_bool stopping;
+    atomic_bool notify; // The owner waits for the inbox to empty
+};
+
+/**
+ * @brief Starts a worker thread.
+ *
+ * The thread blocks all signals and logs through a ring of its own.
+ * <b>OBS</b>: The user has to stop the worker with "worker_destroy".
+ * @param WorkerHandler Called for every message posted.
+ * @param Void* Passed to the handler.
+ * @param size_t Messages each mailbox holds, a power of two.
+ * @param size_t The largest message or reply in bytes.
+ * @param int eventfd to signal replies on, -1 for none.
+ * @return *Worker A pointer to the worker, NULL if it could not be started.
+ */
+Worker *worker_create(WorkerHandler handler, void *context, size_t slots, size_t slotSize, int replyFd);
+
+/**
+ * @brief Handles what was posted, stops the thread and deallocates it.
+ *
+ * Replies that were not taken are dropped.
+ * @param Worker* Pointer to a worker.
+ * @return Void
+ */
+void worker_destroy(Worker *worker);
+
+/**
+ * @brief Posts a copy of a message to the worker, called by the owner.
+ *
+ * @param Worker* Pointer to a worker.
+ * @param Void* The message.
+ * @param size_t The size of the message.
+ * @return Bool False if the inbox is full, nothing is posted then. The
+ * worker writes to the reply descriptor once it has emptied the inbox.
+ */
+bool worker_post(Worker *worker, const void *message, size_t size);
+
+/**
+ * @brief Asks the worker to write to the reply descriptor once it has
+ * handled every message posted, called by the owner.
+ *
+ * If "worker_idle" is false after this call, the write will come.
+ * @param Worker* Pointer to a worker.
+ * @return Void
+ */
+void worker_notify(Worker *worker);
+
+/**
+ * @brief Checks if every message posted has been handled, called by the
+ * owner.
+ *
+ * Once it returns true, the owner may touch what the handler touches
+ * until it posts again.
+ * @param Worker* Pointer to a worker.
+ * @return Bool True if the worker is idle.
+ */
+bool worker_idle(Worker *worker);
+
+/**
+ * @brief Queues a copy of a reply for the owner, called by the handler.
+ *
+ * @param Worker* Pointer to a worker.
+ * @param Void* The reply.
+ * @param size_t The size of the reply.
+ * @return Bool False if the outbox is full, the reply is dropped then.
+ */
+bool worker_reply(Worker *worker, const void *reply, size_t size);
+
+/**
+ * @brief Returns the oldest reply, called by the owner.
+ *
+ * @param Worker* Pointer to a worker.
+ * @param size_t* Set to the size of the reply.
+ * @return Void* The reply, valid until "worker_reply_pop", or NULL.
+ */
+void *worker_reply_front(Worker *worker, size_t *size);
+
+/**
+ * @brief Releases the oldest reply, called by the owner.
+ *
+ * @param Worker* Pointer to a worker with a reply.
+ * @return Void
+ */
+void worker_reply_pop(Worker *worker);
+
+/**
+ * @}
+ */
+
+#endif /* WORKER_H */